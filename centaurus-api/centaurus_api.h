@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 #include <functional>
+#include <stdexcept>
+#include <chrono>
 #include <string>
 #include <vector>
 #include <map>
@@ -43,6 +45,13 @@ typedef enum : unsigned {
 } crobank_file;
 #endif
 
+// Shared leases read the bank concurrently, an exclusive lease keeps
+// everyone else out for maintenance
+enum BankLease {
+    LeaseShared,
+    LeaseExclusive
+};
+
 class ICentaurusBank
 {
 public:
@@ -54,6 +63,10 @@ public:
     virtual bool Connect() = 0;
     virtual void Disconnect() = 0;
 
+    virtual bool AcquireLease(BankLease lease) = 0;
+    virtual void ReleaseLease() = 0;
+    virtual unsigned LeaseCount() const = 0;
+
     virtual void Load(ICronosAPI* cro) = 0;
 
     virtual uint32_t BankFormSaveVer() const = 0;
@@ -69,10 +82,34 @@ public:
     virtual unsigned BaseEnd() const = 0;
 };
 
+// Called from a fetch worker for every requested bank, bank is NULL
+// when it failed to load
+typedef std::function<void(const std::wstring& path,
+    ICentaurusBank* bank)> CentaurusBankCallback;
+
 /* CentaurusTask */
 
 class ICentaurusWorker;
 
+// Scheduling classes, most urgent first
+enum TaskPriority {
+    PriorityInteractive,
+    PriorityExport,
+    PriorityBackground
+};
+
+#define CENTAURUS_PRIORITY_COUNT 3
+
+// Thrown at a window boundary of a cancelled or overdue task
+class CentaurusCancelled : public std::runtime_error
+{
+public:
+    CentaurusCancelled(const std::string& what)
+        : std::runtime_error(what)
+    {
+    }
+};
+
 class ICentaurusTask
 {
 public:
@@ -82,8 +119,20 @@ public:
     virtual void RunTask() = 0;
     virtual void Release() = 0;
     virtual centaurus_size GetMemoryUsage() = 0;
-
-    virtual bool AcquireBank(ICentaurusBank* bank) = 0;
+    virtual centaurus_size EstimateMemory() = 0;
+    virtual TaskPriority GetTaskPriority() const = 0;
+    virtual ICentaurusBank* TaskBank() = 0;
+
+    // honoured by the task at its next window boundary
+    virtual void CancelTask() = 0;
+    virtual void PauseTask() = 0;
+    virtual void ContinueTask() = 0;
+    virtual bool IsTaskCancelled() const = 0;
+    virtual void SetTaskDeadline(
+        std::chrono::steady_clock::time_point deadline) = 0;
+
+    virtual bool AcquireBank(ICentaurusBank* bank,
+        BankLease lease = LeaseShared) = 0;
     virtual CroTable* AcquireTable(CroTable&& table) = 0;
     virtual bool IsBankAcquired(ICentaurusBank* bank) = 0;
     virtual void ReleaseTable(CroTable* table) = 0;
@@ -163,7 +212,8 @@ protected:
 class ICronosAPI
 {
 public:
-    virtual void LoadBank(ICentaurusBank* bank) = 0;
+    virtual void LoadBank(ICentaurusBank* bank,
+        BankLease lease = LeaseShared) = 0;
     virtual CroFile* SetLoaderFile(crobank_file ftype) = 0;
     virtual ICentaurusBank* TargetBank() const = 0;
     virtual CroBank* Bank() const = 0;
@@ -181,7 +231,18 @@ public:
 
 enum ExportFormat {
     ExportCSV,
-    ExportJSON
+    ExportJSON,
+    ExportArrow,
+    ExportParquet,
+    ExportRaw,
+    ExportPostgres,
+    ExportSQLite
+};
+
+enum ExportCompression {
+    CompressNone,
+    CompressGzip,
+    CompressZstd
 };
 
 class ICentaurusExport
@@ -190,6 +251,13 @@ public:
     virtual const std::wstring& ExportPath() const = 0;
     virtual ExportFormat GetExportFormat() const = 0;
     virtual void SetExportFormat(ExportFormat fmt) = 0;
+    virtual ExportCompression GetExportCompression() const = 0;
+    virtual void SetExportCompression(ExportCompression comp,
+        int level = -1) = 0;
+    virtual bool IsExportDelta() const = 0;
+    virtual void SetExportDelta(bool delta, bool hash = false) = 0;
+    virtual bool IsExportDirect() const = 0;
+    virtual void SetExportDirect(bool direct) = 0;
     virtual void SyncBankJson() = 0;
 };
 
@@ -197,6 +265,7 @@ public:
 
 #define CENTAURUS_API_TABLE_LIMIT (512*1024*1024)
 #define CENTAURUS_API_WORKER_LIMIT (4)
+#define CENTAURUS_API_FETCH_LIMIT (4)
 
 class ICentaurusAPI
 {
@@ -208,6 +277,7 @@ public:
 
     virtual void SetMemoryLimit(centaurus_size limit) = 0;
     virtual void SetWorkerLimit(unsigned threads) = 0;
+    virtual void SetFetchLimit(unsigned threads) = 0;
     virtual centaurus_size TotalMemoryUsage() = 0;
     virtual centaurus_size GetMemoryLimit() = 0;
     virtual centaurus_size GetWorkerMemoryLimit() = 0;
@@ -222,6 +292,11 @@ public:
 
     virtual std::wstring BankFile(ICentaurusBank* bank) = 0;
     virtual void ConnectBank(const std::wstring& dir) = 0;
+    virtual void ConnectBank(const std::wstring& dir,
+        CentaurusBankCallback callback) = 0;
+    virtual void FindBanks(const std::wstring& path,
+        CentaurusBankCallback callback) = 0;
+    virtual void WaitFetch() = 0;
     virtual void DisconnectBank(ICentaurusBank* bank) = 0;
     virtual ICentaurusBank* FindBank(const std::wstring& path) = 0;
     virtual ICentaurusBank* WaitBank(const std::wstring& dir) = 0;
@@ -233,6 +308,9 @@ public:
 
     virtual std::wstring TaskFile(ICentaurusTask* task) = 0;
     virtual void StartTask(ICentaurusTask* task) = 0;
+    // task starts when all of after have completed, skipped if one failed
+    virtual void StartTask(ICentaurusTask* task,
+        const std::vector<ICentaurusTask*>& after) = 0;
     virtual void ReleaseTask(ICentaurusTask* task) = 0;
 
     virtual void Run() = 0;
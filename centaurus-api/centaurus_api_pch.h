@@ -6,6 +6,7 @@
 #include "worker.h"
 #include "job.h"
 #include "scheduler.h"
+#include "coro.h"
 #include "logger.h"
 
 #endif
\ No newline at end of file
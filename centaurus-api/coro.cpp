@@ -0,0 +1,196 @@
+#include "coro.h"
+#include "job.h"
+#include "scheduler.h"
+
+/* CentaurusCoro */
+
+CentaurusCoro::CentaurusCoro()
+    : m_Handle(NULL)
+{
+}
+
+CentaurusCoro::CentaurusCoro(std::coroutine_handle<promise_type> handle)
+    : m_Handle(handle)
+{
+}
+
+CentaurusCoro::CentaurusCoro(CentaurusCoro&& coro) noexcept
+    : m_Handle(coro.m_Handle)
+{
+    coro.m_Handle = NULL;
+}
+
+CentaurusCoro& CentaurusCoro::operator=(CentaurusCoro&& coro) noexcept
+{
+    if (this != &coro)
+    {
+        if (m_Handle) m_Handle.destroy();
+        m_Handle = coro.m_Handle;
+        coro.m_Handle = NULL;
+    }
+
+    return *this;
+}
+
+CentaurusCoro::~CentaurusCoro()
+{
+    if (m_Handle) m_Handle.destroy();
+}
+
+bool CentaurusCoro::IsDone() const
+{
+    return !m_Handle || m_Handle.done();
+}
+
+void CentaurusCoro::Resume()
+{
+    if (IsDone()) return;
+
+    m_Handle.resume();
+    if (m_Handle.done() && m_Handle.promise().m_Error)
+        std::rethrow_exception(m_Handle.promise().m_Error);
+}
+
+/* CentaurusAwait */
+
+CentaurusAwait::CentaurusAwait(CentaurusCoroTask* task,
+    std::function<void()> op)
+    : m_pTask(task), m_Op(std::move(op))
+{
+}
+
+void CentaurusAwait::await_suspend(std::coroutine_handle<> handle)
+{
+    // the job dispatches the wait once it has left the task
+    m_pTask->m_pAwait = this;
+}
+
+void CentaurusAwait::await_resume()
+{
+    if (!m_Op) m_pTask->JoinResult();
+    if (m_Error) std::rethrow_exception(m_Error);
+}
+
+/* CentaurusCoroTask */
+
+CentaurusCoroTask::CentaurusCoroTask()
+    : CentaurusTask("CentaurusCoroTask")
+{
+    m_pScheduler = NULL;
+    m_pAwait = NULL;
+}
+
+CentaurusCoroTask::CentaurusCoroTask(const std::string& taskName)
+    : CentaurusTask(taskName)
+{
+    m_pScheduler = NULL;
+    m_pAwait = NULL;
+}
+
+CentaurusCoroTask::~CentaurusCoroTask()
+{
+}
+
+void CentaurusCoroTask::RunTask()
+{
+    CentaurusJob* job = CentaurusJob::CurrentJob();
+    m_pScheduler = job ? job->Scheduler() : NULL;
+
+    // a resume is a window boundary too
+    if (m_Coro.IsValid()) CheckTask();
+    else m_Coro = Run();
+    m_Coro.Resume();
+
+    // not on the pool, complete every wait in place
+    while (!m_pScheduler && m_pAwait)
+    {
+        CentaurusAwait* await = m_pAwait;
+        m_pAwait = NULL;
+
+        if (await->m_Op)
+        {
+            try {
+                await->m_Op();
+            }
+            catch (...) {
+                await->m_Error = std::current_exception();
+            }
+        }
+
+        m_Coro.Resume();
+    }
+}
+
+bool CentaurusCoroTask::Suspended() const
+{
+    return m_pAwait != NULL;
+}
+
+void CentaurusCoroTask::Dispatch()
+{
+    CentaurusAwait* await = m_pAwait;
+    m_pAwait = NULL;
+
+    if (!await->m_Op)
+    {
+        {
+            auto lock = boost::mutex::scoped_lock(m_JoinLock);
+            if (m_Forked)
+            {
+                m_bJoinAwait = true;
+                return;
+            }
+        }
+
+        Resume();
+        return;
+    }
+
+    m_pScheduler->AwaitIO([this, await]() {
+        try {
+            await->m_Op();
+        }
+        catch (...) {
+            await->m_Error = std::current_exception();
+        }
+
+        Resume();
+    });
+}
+
+void CentaurusCoroTask::Resume()
+{
+    m_pScheduler->ResumeTask(this);
+}
+
+CentaurusAwait CentaurusCoroTask::ReadAsync(CroFile* file, CroData& data,
+    cronos_id id, cronos_filetype ftype, cronos_pos pos, cronos_size size,
+    cronos_idx count)
+{
+    return CentaurusAwait(this, [=, &data]() {
+        file->Read(data, id, ftype, pos, size, count);
+    });
+}
+
+CentaurusAwait CentaurusCoroTask::ReadRecordAsync(CroFile* file,
+    CroBuffer& record, cronos_id id)
+{
+    return CentaurusAwait(this, [=, &record]() {
+        record = file->ReadRecord(id);
+    });
+}
+
+CentaurusAwait CentaurusCoroTask::FlushAsync(CroSync* sync)
+{
+    return CentaurusAwait(this, [sync]() { sync->Flush(); });
+}
+
+CentaurusAwait CentaurusCoroTask::JoinAsync()
+{
+    return CentaurusAwait(this, nullptr);
+}
+
+CentaurusAwait CentaurusCoroTask::Offload(std::function<void()> op)
+{
+    return CentaurusAwait(this, std::move(op));
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#ifndef __CENTAURUS_CORO_H
+#define __CENTAURUS_CORO_H
+
+#include "task.h"
+#include <crofile.h>
+#include <crosync.h>
+#include <coroutine>
+#include <exception>
+#include <functional>
+
+class CentaurusScheduler;
+class CentaurusCoroTask;
+
+// Coroutine body of a CentaurusCoroTask. Starts suspended, the task
+// resumes it from RunTask and keeps the frame until it is released.
+class CENTAURUS_API CentaurusCoro
+{
+public:
+    struct promise_type {
+        std::exception_ptr m_Error;
+
+        CentaurusCoro get_return_object()
+        {
+            return CentaurusCoro(
+                std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { m_Error = std::current_exception(); }
+    };
+
+    CentaurusCoro();
+    CentaurusCoro(std::coroutine_handle<promise_type> handle);
+    CentaurusCoro(CentaurusCoro&& coro) noexcept;
+    CentaurusCoro& operator=(CentaurusCoro&& coro) noexcept;
+    ~CentaurusCoro();
+
+    inline bool IsValid() const { return (bool)m_Handle; }
+    bool IsDone() const;
+    void Resume();
+private:
+    std::coroutine_handle<promise_type> m_Handle;
+};
+
+// What a coroutine waits on: an operation run on the scheduler I/O
+// threads, or the subtasks forked so far when there is no operation.
+class CENTAURUS_API CentaurusAwait
+{
+public:
+    CentaurusAwait(CentaurusCoroTask* task, std::function<void()> op);
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume();
+private:
+    friend class CentaurusCoroTask;
+
+    CentaurusCoroTask* m_pTask;
+    std::function<void()> m_Op;
+    std::exception_ptr m_Error;
+};
+
+// Task whose body may suspend on I/O and joins instead of blocking its
+// job. A suspended task keeps its grant and leaves the job, the I/O
+// thread or last subtask that completes the wait queues it again and
+// any job resumes it. Off the pool awaits complete in place.
+class CENTAURUS_API CentaurusCoroTask : public CentaurusTask
+{
+public:
+    CentaurusCoroTask();
+    CentaurusCoroTask(const std::string& taskName);
+    virtual ~CentaurusCoroTask();
+
+    virtual CentaurusCoro Run() = 0;
+    void RunTask() override;
+
+    bool Suspended() const;
+    void Dispatch();
+
+    CentaurusAwait ReadAsync(CroFile* file, CroData& data, cronos_id id,
+        cronos_filetype ftype, cronos_pos pos, cronos_size size,
+        cronos_idx count = 1);
+    CentaurusAwait ReadRecordAsync(CroFile* file, CroBuffer& record,
+        cronos_id id);
+    CentaurusAwait FlushAsync(CroSync* sync);
+    CentaurusAwait JoinAsync();
+    CentaurusAwait Offload(std::function<void()> op);
+protected:
+    void Resume() override;
+private:
+    friend class CentaurusAwait;
+
+    CentaurusCoro m_Coro;
+    CentaurusScheduler* m_pScheduler;
+    CentaurusAwait* m_pAwait;
+};
+
+#endif
\ No newline at end of file
@@ -1,12 +1,16 @@
 #include "job.h"
+#include "scheduler.h"
+#include "coro.h"
 //#include "api.h"
 #include <croexception.h>
 #include <crofile.h>
 #include <win32util.h>
 #include <stdexcept>
 
-CentaurusJob::CentaurusJob(ICentaurusTask* task)
-    : m_pTask(task)
+static thread_local CentaurusJob* _current_job = NULL;
+
+CentaurusJob::CentaurusJob(CentaurusScheduler* scheduler)
+    : m_pScheduler(scheduler), m_pTask(NULL)
 {
 }
 
@@ -16,11 +20,36 @@ CentaurusJob::~CentaurusJob()
 
 void CentaurusJob::Execute()
 {
-    m_pTask->Invoke(this);
+    _current_job = this;
+
+    ICentaurusTask* task = m_pScheduler->TakeTask(this);
+    if (task) RunTask(task);
+}
+
+void CentaurusJob::RunTask(ICentaurusTask* task)
+{
+    ICentaurusTask* outer = m_pTask;
+    // subtasks belong to their parent and may be gone after RunTask
+    bool owned = dynamic_cast<CentaurusSubtask*>(task) == NULL;
+    auto* coro = dynamic_cast<CentaurusCoroTask*>(task);
+
+    // the task takes its admitted grant as limit on Invoke
+    centaurus_size limit = GetMemoryLimit();
+    centaurus_size grant = m_pScheduler->TaskGrant(task);
+    if (grant) SetMemoryLimit(grant);
+
+    {
+        auto lock = scoped_lock(m_QueueLock);
+        m_pTask = task;
+    }
+    task->Invoke(this);
+    SetMemoryLimit(limit);
+    bool failed = false;
     try {
-        m_pTask->RunTask();
+        task->RunTask();
     }
     catch (std::exception& e) {
+        failed = true;
         centaurus->OnException(e);
         /*_centaurus->TaskSyncJSON(m_pTask, {
             {"error", {
@@ -30,10 +59,92 @@ void CentaurusJob::Execute()
         });*/
     }
 
-    m_State = Terminated;
+    {
+        auto lock = scoped_lock(m_QueueLock);
+        m_pTask = outer;
+    }
+
+    // a suspended coroutine is not done, whatever it waits on queues it
+    // again, so the task is not touched after Dispatch
+    if (coro && coro->Suspended())
+    {
+        coro->Dispatch();
+        return;
+    }
+
+    if (owned) m_pScheduler->TaskDone(task, failed);
+}
+
+bool CentaurusJob::RunLocalTask()
+{
+    // a joining task runs its own children instead of blocking the job
+    ICentaurusTask* task = m_pScheduler->TakeLocalTask(this);
+    if (!task) return false;
+
+    RunTask(task);
+    return true;
+}
+
+bool CentaurusJob::RunUrgentTask()
+{
+    // a task at its window boundary lets more urgent work go first
+    ICentaurusTask* outer = m_pTask;
+    ICentaurusTask* task = outer
+        ? m_pScheduler->TakeUrgentTask(this, outer) : NULL;
+    if (!task) return false;
+
+    RunTask(task);
+    return true;
 }
 
 ICentaurusTask* CentaurusJob::JobTask()
 {
     return m_pTask;
 }
+
+void CentaurusJob::CancelJobTask()
+{
+    // the task is not released while it is the job task
+    auto lock = scoped_lock(m_QueueLock);
+    ICentaurusTask* task = m_pTask;
+    if (task) task->CancelTask();
+}
+
+CentaurusJob* CentaurusJob::CurrentJob()
+{
+    return _current_job;
+}
+
+void CentaurusJob::PushTask(ICentaurusTask* task)
+{
+    auto lock = scoped_lock(m_QueueLock);
+    m_Queue.push_back(task);
+}
+
+ICentaurusTask* CentaurusJob::PopTask()
+{
+    auto lock = scoped_lock(m_QueueLock);
+    if (m_Queue.empty()) return NULL;
+
+    ICentaurusTask* task = m_Queue.back();
+    m_Queue.pop_back();
+    return task;
+}
+
+ICentaurusTask* CentaurusJob::StealTask()
+{
+    auto lock = scoped_lock(m_QueueLock);
+    if (m_Queue.empty()) return NULL;
+
+    ICentaurusTask* task = m_Queue.front();
+    m_Queue.pop_front();
+    return task;
+}
+
+std::deque<ICentaurusTask*> CentaurusJob::DrainTasks()
+{
+    std::deque<ICentaurusTask*> tasks;
+    auto lock = scoped_lock(m_QueueLock);
+    tasks.swap(m_Queue);
+    return tasks;
+}
\ No newline at end of file
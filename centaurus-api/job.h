@@ -2,18 +2,39 @@
 #define __CENTAURUS_JOB_H
 
 #include "worker.h"
+#include <deque>
 
+class CentaurusScheduler;
+
+// Pool thread of CentaurusScheduler. Tasks started from a job are pushed
+// to its own deque and taken LIFO, idle jobs steal from the other end.
 class CENTAURUS_API CentaurusJob : public CentaurusWorker
 {
 public:
-    CentaurusJob(ICentaurusTask* task);
+    CentaurusJob(CentaurusScheduler* scheduler);
     virtual ~CentaurusJob();
 
     void Execute() override;
 
     ICentaurusTask* JobTask();
+    void CancelJobTask();
+    inline CentaurusScheduler* Scheduler() const { return m_pScheduler; }
+    static CentaurusJob* CurrentJob();
+
+    void RunTask(ICentaurusTask* task);
+    bool RunLocalTask();
+    bool RunUrgentTask();
+
+    void PushTask(ICentaurusTask* task);
+    ICentaurusTask* PopTask();
+    ICentaurusTask* StealTask();
+    std::deque<ICentaurusTask*> DrainTasks();
 protected:
-    ICentaurusTask* m_pTask;
+    CentaurusScheduler* m_pScheduler;
+    boost::atomic<ICentaurusTask*> m_pTask;
+
+    boost::mutex m_QueueLock;
+    std::deque<ICentaurusTask*> m_Queue;
 };
 
 #endif
\ No newline at end of file
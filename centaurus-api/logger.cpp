@@ -188,7 +188,7 @@ void CentaurusLogger::LogBankFiles(ICentaurusBank* bank)
     auto lock = scoped_lock(GetLogBoostMutex());
     static const char* _croName[] = { "CroStru", "CroBank", "CroIndex" };
 
-    bank->Connect();
+    if (!bank->AcquireLease(LeaseShared)) return;
 
     for (unsigned i = 0; i < CROFILE_COUNT; i++)
     {
@@ -207,7 +207,7 @@ void CentaurusLogger::LogBankFiles(ICentaurusBank* bank)
         );
     }
 
-    bank->Disconnect();
+    bank->ReleaseLease();
 }
 
 void CentaurusLogger::LogBankStructure(ICentaurusBank* bank)
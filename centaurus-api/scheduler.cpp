@@ -1,33 +1,484 @@
 #include "scheduler.h"
+#include <algorithm>
+
+/* CentaurusTaskQueue */
+
+void CentaurusTaskQueue::Push(ICentaurusTask* task)
+{
+    unsigned cls = std::min<unsigned>(task->GetTaskPriority(),
+        CENTAURUS_PRIORITY_COUNT - 1);
+    ICentaurusBank* bank = task->TaskBank();
+
+    auto& queue = m_Classes[cls];
+    auto& tasks = queue.m_Banks[bank];
+    if (tasks.empty()) queue.m_Order.push_back(bank);
+
+    tasks.push_back({ task, std::chrono::steady_clock::now() });
+}
+
+ICentaurusTask* CentaurusTaskQueue::Pop(unsigned classes)
+{
+    auto now = std::chrono::steady_clock::now();
+    int best = -1;
+    long long bestRank = 0;
+
+    // head of each class is the next bank in turn, its oldest task
+    // decides how far the class has aged, no further than the
+    // interactive class; on a tie the more urgent class wins
+    for (unsigned cls = 0; cls < classes && cls < CENTAURUS_PRIORITY_COUNT;
+        cls++)
+    {
+        auto& queue = m_Classes[cls];
+        if (queue.m_Order.empty()) continue;
+
+        const auto& head = queue.m_Banks[queue.m_Order.front()].front();
+        long long rank = std::max(0LL, (long long)cls
+            - (now - head.m_Time) / CENTAURUS_AGING_INTERVAL);
+        if (best < 0 || rank < bestRank)
+        {
+            best = cls;
+            bestRank = rank;
+        }
+    }
+
+    if (best < 0) return NULL;
+
+    auto& queue = m_Classes[best];
+    ICentaurusBank* bank = queue.m_Order.front();
+    queue.m_Order.pop_front();
+
+    auto& tasks = queue.m_Banks[bank];
+    ICentaurusTask* task = tasks.front().m_pTask;
+    tasks.pop_front();
+
+    if (tasks.empty()) queue.m_Banks.erase(bank);
+    else queue.m_Order.push_back(bank);
+
+    return task;
+}
+
+bool CentaurusTaskQueue::Empty() const
+{
+    for (const auto& queue : m_Classes)
+        if (!queue.m_Order.empty()) return false;
+    return true;
+}
+
+/* CentaurusScheduler */
 
 CentaurusScheduler::CentaurusScheduler(unsigned poolSize)
 {
     m_uPoolSize = poolSize;
+    m_Queued = 0;
+    m_Reserved = 0;
+    m_bIOStop = false;
 }
 
-void CentaurusScheduler::SetPoolSize(unsigned poolSize)
+CentaurusScheduler::~CentaurusScheduler()
+{
+    StopIO();
+
+    for (auto& job : m_Jobs)
+    {
+        job->Stop();
+        job->Wait();
+    }
+}
+
+void CentaurusScheduler::Start()
+{
+    CentaurusWorker::Start();
+    SetPoolSize(m_uPoolSize);
+
+    auto lock = scoped_lock(m_IOLock);
+    m_bIOStop = false;
+    while (m_IOThreads.size() < CENTAURUS_IO_THREADS)
+        m_IOThreads.emplace_back([this]() { RunIO(); });
+}
+
+void CentaurusScheduler::Stop()
+{
+    {
+        auto lock = scoped_lock(m_DataLock);
+        for (auto& job : m_Jobs)
+        {
+            // interruption points are never reached inside an export,
+            // the task stops at its next window boundary instead
+            job->Stop();
+            job->CancelJobTask();
+        }
+    }
+
+    StopIO();
+    CentaurusWorker::Stop();
+}
+
+void CentaurusScheduler::StopIO()
+{
+    {
+        auto lock = scoped_lock(m_IOLock);
+        m_bIOStop = true;
+    }
+    m_IOCond.notify_all();
+
+    std::vector<boost::thread> threads;
+    {
+        auto lock = scoped_lock(m_IOLock);
+        threads.swap(m_IOThreads);
+    }
+    for (auto& thread : threads) thread.join();
+}
+
+void CentaurusScheduler::RunIO()
+{
+    for (;;)
+    {
+        std::function<void()> op;
+        {
+            boost::unique_lock<boost::mutex> lock(m_IOLock);
+            while (m_IOQueue.empty() && !m_bIOStop)
+                m_IOCond.wait(lock);
+
+            // queued operations still complete, their tasks are waiting
+            if (m_IOQueue.empty()) return;
+            op = std::move(m_IOQueue.front());
+            m_IOQueue.pop_front();
+        }
+
+        op();
+    }
+}
+
+void CentaurusScheduler::AwaitIO(std::function<void()> op)
+{
+    {
+        auto lock = scoped_lock(m_IOLock);
+        m_IOQueue.push_back(std::move(op));
+    }
+    m_IOCond.notify_one();
+}
+
+void CentaurusScheduler::ResumeTask(ICentaurusTask* task)
+{
+    Log("ResumeTask %p\n", task);
+    Enqueue(task);
+}
+
+unsigned CentaurusScheduler::PoolSize()
 {
     auto lock = scoped_lock(m_DataLock);
-    m_uPoolSize = poolSize;
+    return m_uPoolSize;
+}
+
+void CentaurusScheduler::SetPoolSize(unsigned poolSize)
+{
+    std::vector<std::unique_ptr<CentaurusJob>> stopped;
+    {
+        auto lock = scoped_lock(m_DataLock);
+        m_uPoolSize = poolSize ? poolSize : 1;
+
+        while (m_Jobs.size() < m_uPoolSize)
+        {
+            CentaurusJob* job = m_Jobs.emplace_back(
+                new CentaurusJob(this)).get();
+            job->SetMemoryLimit(centaurus->GetWorkerMemoryLimit());
+
+            job->Start();
+            Log("Pool %s\n", job->GetName().c_str());
+        }
+
+        while (m_Jobs.size() > m_uPoolSize)
+        {
+            stopped.push_back(std::move(m_Jobs.back()));
+            m_Jobs.pop_back();
+        }
+    }
+
+    // a running task completes before its job stops, queued ones move
+    // to the shared queue
+    for (auto& job : stopped)
+    {
+        job->Stop();
+        job->Wait();
+
+        auto tasks = job->DrainTasks();
+        if (tasks.empty()) continue;
+        {
+            auto lock = scoped_lock(m_QueueLock);
+            for (auto* task : tasks) m_Queue.Push(task);
+        }
+        m_IdleCond.notify_all();
+    }
+}
+
+void CentaurusScheduler::Queued()
+{
+    {
+        auto lock = scoped_lock(m_IdleLock);
+        m_Queued++;
+    }
+    m_IdleCond.notify_one();
 }
 
 void CentaurusScheduler::ScheduleTask(ICentaurusTask* task)
 {
-    auto dataLock = scoped_lock(m_DataLock);
-    while (m_Jobs.size() >= m_uPoolSize)
-        m_DataCond.wait(dataLock);
+    ScheduleTask(task, {});
+}
+
+void CentaurusScheduler::ScheduleTask(ICentaurusTask* task,
+    const std::vector<ICentaurusTask*>& inputs)
+{
+    // subtasks are joined by their parent, they never enter the graph
+    if (!dynamic_cast<CentaurusSubtask*>(task))
+    {
+        auto lock = scoped_lock(m_GraphLock);
+        centaurus_node& node = m_Graph[task];
+        node.m_Inputs = 0;
+        node.m_bFailed = false;
+
+        // an input not in the graph has already completed
+        for (ICentaurusTask* input : inputs)
+        {
+            auto it = m_Graph.find(input);
+            if (it == m_Graph.end() || input == task) continue;
 
+            it->second.m_Outputs.push_back(task);
+            node.m_Inputs++;
+        }
+
+        if (node.m_Inputs)
+        {
+            Log("ScheduleTask %p after %u\n", task, node.m_Inputs);
+            return;
+        }
+    }
+
+    Enqueue(task);
+}
+
+void CentaurusScheduler::Enqueue(ICentaurusTask* task)
+{
+    // only subtasks stay on the forking job, everything else goes
+    // through the shared queue by priority and bank
+    CentaurusJob* job = CentaurusJob::CurrentJob();
+    if (job && job->State() != ICentaurusWorker::Terminated
+        && dynamic_cast<CentaurusSubtask*>(task))
     {
-        //auto lock = scoped_lock(m_DataLock);
-        CentaurusJob* job = m_Jobs.emplace_back(
-            new CentaurusJob(task)).get();
-        job->SetMemoryLimit(centaurus->GetWorkerMemoryLimit());
-        
-        job->Start();
+        job->PushTask(task);
         Log("ScheduleTask %p -> %s\n", task, job->GetName().c_str());
     }
+    else
+    {
+        auto lock = scoped_lock(m_QueueLock);
+        m_Queue.Push(task);
+        Log("ScheduleTask %p\n", task);
+    }
+
+    Queued();
+}
+
+ICentaurusTask* CentaurusScheduler::TakeTask(CentaurusJob* job)
+{
+    while (job->State() != ICentaurusWorker::Terminated)
+    {
+        ICentaurusTask* task = job->PopTask();
+        if (!task)
+        {
+            auto lock = scoped_lock(m_QueueLock);
+            task = m_Queue.Pop();
+        }
+
+        if (!task)
+        {
+            auto lock = scoped_lock(m_DataLock);
+            for (auto& other : m_Jobs)
+            {
+                if (other.get() != job && (task = other->StealTask()))
+                    break;
+            }
+        }
+
+        if (task)
+        {
+            m_Queued--;
+            if (Admit(task)) return task;
+
+            auto lock = scoped_lock(m_QueueLock);
+            m_Deferred.push_back(task);
+            continue;
+        }
+
+        boost::unique_lock<boost::mutex> lock(m_IdleLock);
+        while (m_Queued <= 0 && job->State() != ICentaurusWorker::Terminated)
+            m_IdleCond.wait(lock);
+    }
+
+    return NULL;
+}
+
+ICentaurusTask* CentaurusScheduler::TakeLocalTask(CentaurusJob* job)
+{
+    ICentaurusTask* task = job->PopTask();
+    if (!task) return NULL;
+
+    m_Queued--;
+    if (Admit(task)) return task;
+
+    auto lock = scoped_lock(m_QueueLock);
+    m_Deferred.push_back(task);
+    return NULL;
+}
+
+ICentaurusTask* CentaurusScheduler::TakeUrgentTask(CentaurusJob* job,
+    ICentaurusTask* outer)
+{
+    ICentaurusTask* task;
+    {
+        auto lock = scoped_lock(m_QueueLock);
+        task = m_Queue.Pop(outer->GetTaskPriority());
+    }
+    if (!task) return NULL;
+
+    m_Queued--;
+    Log("TakeUrgentTask %p before %p\n", task, outer);
+
+    // the yielding task has released its window, lend its grant
+    centaurus_size lent = 0;
+    {
+        auto lock = scoped_lock(m_GrantLock);
+        auto it = m_Grants.find(outer);
+        if (it != m_Grants.end()) lent = it->second;
+        m_Reserved -= lent;
+    }
+    bool admitted = Admit(task);
+    {
+        auto lock = scoped_lock(m_GrantLock);
+        m_Reserved += lent;
+    }
+    if (admitted) return task;
+
+    auto lock = scoped_lock(m_QueueLock);
+    m_Deferred.push_back(task);
+    return NULL;
+}
+
+bool CentaurusScheduler::Admit(ICentaurusTask* task)
+{
+    if (dynamic_cast<CentaurusSubtask*>(task)) return true;
+
+    centaurus_size limit = centaurus->GetMemoryLimit();
+    centaurus_size share = centaurus->GetWorkerMemoryLimit();
+    centaurus_size usage = centaurus->TotalMemoryUsage();
+    centaurus_size want = task->EstimateMemory();
+    if (!want) want = share;
+
+    auto lock = scoped_lock(m_GrantLock);
+    // resumed coroutine, still holds the grant it was admitted with
+    if (m_Grants.count(task)) return true;
+
+    centaurus_size used = std::max(m_Reserved, usage);
+    centaurus_size spare = used < limit ? limit - used : 0;
+    centaurus_size minimum = std::min(want, share / CENTAURUS_ADMIT_MIN_SHARE);
+
+    // nothing running, always make progress
+    if (spare < minimum && !m_Grants.empty()) return false;
+
+    // leave half of the spare memory while more work is waiting
+    centaurus_size offer = m_Queued > 0 ? spare / 2 : spare;
+    centaurus_size grant = std::max(std::min(want, offer), minimum);
+
+    m_Grants[task] = grant;
+    m_Reserved += grant;
+    return true;
+}
+
+centaurus_size CentaurusScheduler::TaskGrant(ICentaurusTask* task)
+{
+    auto lock = scoped_lock(m_GrantLock);
+    auto it = m_Grants.find(task);
+    return it != m_Grants.end() ? it->second : 0;
+}
+
+void CentaurusScheduler::Resolve(ICentaurusTask* task, bool failed,
+    std::vector<ICentaurusTask*>& ready,
+    std::vector<ICentaurusTask*>& skipped)
+{
+    std::vector<std::pair<ICentaurusTask*, bool>> done = { { task, failed } };
+    while (!done.empty())
+    {
+        auto [input, inputFailed] = done.back();
+        done.pop_back();
+
+        auto it = m_Graph.find(input);
+        if (it == m_Graph.end()) continue;
+
+        std::vector<ICentaurusTask*> outputs;
+        outputs.swap(it->second.m_Outputs);
+        m_Graph.erase(it);
+
+        for (ICentaurusTask* output : outputs)
+        {
+            centaurus_node& node = m_Graph[output];
+            if (inputFailed) node.m_bFailed = true;
+            if (--node.m_Inputs) continue;
+
+            if (node.m_bFailed)
+            {
+                skipped.push_back(output);
+                done.push_back({ output, true });
+            }
+            else ready.push_back(output);
+        }
+    }
+}
 
-    m_SyncCond.notify_one();
+void CentaurusScheduler::TaskDone(ICentaurusTask* task, bool failed)
+{
+    {
+        auto lock = scoped_lock(m_GrantLock);
+        auto it = m_Grants.find(task);
+        if (it != m_Grants.end())
+        {
+            m_Reserved -= it->second;
+            m_Grants.erase(it);
+        }
+    }
+
+    // released memory may admit deferred tasks
+    size_t deferred = 0;
+    {
+        auto lock = scoped_lock(m_QueueLock);
+        deferred = m_Deferred.size();
+        for (auto* task : m_Deferred) m_Queue.Push(task);
+        m_Deferred.clear();
+    }
+    if (deferred)
+    {
+        {
+            auto lock = scoped_lock(m_IdleLock);
+            m_Queued += deferred;
+        }
+        m_IdleCond.notify_all();
+    }
+
+    // the last input queues its outputs, on this job first
+    std::vector<ICentaurusTask*> ready, skipped;
+    {
+        auto lock = scoped_lock(m_GraphLock);
+        Resolve(task, failed, ready, skipped);
+    }
+    for (ICentaurusTask* output : ready) Enqueue(output);
+
+    {
+        auto lock = scoped_lock(m_DoneLock);
+        m_Done.push_back(task);
+        for (ICentaurusTask* output : skipped)
+        {
+            Log("%p skipped, input failed\n", output);
+            m_Done.push_back(output);
+        }
+    }
+    m_DoneCond.notify_one();
 }
 
 std::string CentaurusScheduler::TaskName(ICentaurusTask* task)
@@ -45,30 +496,18 @@ std::string CentaurusScheduler::TaskName(ICentaurusTask* task)
 
 void CentaurusScheduler::Execute()
 {
-    if (m_Jobs.empty())
+    std::deque<ICentaurusTask*> done;
     {
-        m_State = Waiting;
-        return;
+        boost::unique_lock<boost::mutex> lock(m_DoneLock);
+        while (m_Done.empty())
+            m_DoneCond.wait(lock);
+
+        done.swap(m_Done);
     }
 
+    for (ICentaurusTask* task : done)
     {
-        auto lock = scoped_lock(m_DataLock);
-        for (unsigned i = 0; i < m_Jobs.size();)
-        {
-            auto it = m_Jobs.begin() + i;
-            auto job = it->get();
-
-            if (job->State() == ICentaurusWorker::Terminated)
-            {
-                Log("%s terminated.\n", job->GetName().c_str());
-                ICentaurusTask* task = job->JobTask();
-
-                centaurus->ReleaseTask(task);
-                
-                m_Jobs.erase(it);
-                m_DataCond.notify_all();
-            }
-            else i++;
-        }
+        Log("%p done.\n", task);
+        centaurus->ReleaseTask(task);
     }
-}
+}
\ No newline at end of file
@@ -3,20 +3,127 @@
 
 #include "worker.h"
 #include "job.h"
+#include <deque>
+#include <map>
+#include <vector>
+#include <chrono>
+#include <functional>
 
+// smallest grant is the worker share divided by this
+#define CENTAURUS_ADMIT_MIN_SHARE 4
+// a waiting task is raised by one priority class per interval
+#define CENTAURUS_AGING_INTERVAL std::chrono::seconds(60)
+// threads blocking in awaited I/O on behalf of suspended tasks
+#define CENTAURUS_IO_THREADS 4
+
+struct centaurus_queued {
+    ICentaurusTask* m_pTask;
+    std::chrono::steady_clock::time_point m_Time;
+};
+
+// Task waiting on its inputs. Outputs are tasks that wait on this one.
+struct centaurus_node {
+    unsigned m_Inputs;
+    bool m_bFailed;
+    std::vector<ICentaurusTask*> m_Outputs;
+};
+
+// Shared queue by priority class. Inside a class banks take turns, so
+// one bank with many tasks does not hold back the others. Waiting tasks
+// age towards the interactive class but never past it.
+class CENTAURUS_API CentaurusTaskQueue
+{
+public:
+    void Push(ICentaurusTask* task);
+    // classes limits the pop to the first, more urgent, classes
+    ICentaurusTask* Pop(unsigned classes = CENTAURUS_PRIORITY_COUNT);
+    bool Empty() const;
+private:
+    struct priority_queue {
+        std::deque<ICentaurusBank*> m_Order;
+        std::map<ICentaurusBank*, std::deque<centaurus_queued>> m_Banks;
+    };
+
+    priority_queue m_Classes[CENTAURUS_PRIORITY_COUNT];
+};
+
+// Fixed pool of jobs with work stealing. ScheduleTask never blocks:
+// a subtask forked on a job thread goes to that job's deque, every
+// other task to the shared queue. Idle jobs sleep until work is queued,
+// the scheduler thread sleeps until a job posts a completed task.
+// A task starts only when its estimated working set fits next to the
+// grants of running tasks and live usage, otherwise it is deferred
+// until memory is released. Subtasks live in their parent's grant.
+// A task scheduled after other tasks is held in the graph, without a
+// thread, and queued by whichever job completes its last input. When
+// an input failed, the dependent tasks are released without running.
+// Coroutine tasks suspended on I/O hand the call to the I/O threads and
+// are queued again by ResumeTask, keeping their grant meanwhile.
+// Long tasks yield at window boundaries to queued tasks of a more urgent
+// class, which run on the same job and may use the yielding grant.
 class CENTAURUS_API CentaurusScheduler : public CentaurusWorker
 {
 public:
     CentaurusScheduler(unsigned poolSize = 8);
+    virtual ~CentaurusScheduler();
+
+    void Start() override;
+    void Stop() override;
     
     void SetPoolSize(unsigned poolSize);
+    unsigned PoolSize();
     void ScheduleTask(ICentaurusTask* task);
+    void ScheduleTask(ICentaurusTask* task,
+        const std::vector<ICentaurusTask*>& inputs);
     std::string TaskName(ICentaurusTask* task);
+
+    ICentaurusTask* TakeTask(CentaurusJob* job);
+    ICentaurusTask* TakeLocalTask(CentaurusJob* job);
+    ICentaurusTask* TakeUrgentTask(CentaurusJob* job, ICentaurusTask* outer);
+    void TaskDone(ICentaurusTask* task, bool failed = false);
+    centaurus_size TaskGrant(ICentaurusTask* task);
+
+    void AwaitIO(std::function<void()> op);
+    void ResumeTask(ICentaurusTask* task);
 protected:
     void Execute() override;
 private:
+    void Queued();
+    void Enqueue(ICentaurusTask* task);
+    void RunIO();
+    void StopIO();
+    bool Admit(ICentaurusTask* task);
+    void Resolve(ICentaurusTask* task, bool failed,
+        std::vector<ICentaurusTask*>& ready,
+        std::vector<ICentaurusTask*>& skipped);
+
     std::vector<std::unique_ptr<CentaurusJob>> m_Jobs;
     unsigned m_uPoolSize;
+
+    boost::mutex m_QueueLock;
+    CentaurusTaskQueue m_Queue;
+
+    boost::mutex m_IdleLock;
+    boost::condition_variable m_IdleCond;
+    boost::atomic_int32_t m_Queued;
+    std::deque<ICentaurusTask*> m_Deferred;
+
+    boost::mutex m_GrantLock;
+    std::map<ICentaurusTask*, centaurus_size> m_Grants;
+    centaurus_size m_Reserved;
+
+    boost::mutex m_IOLock;
+    boost::condition_variable m_IOCond;
+    std::deque<std::function<void()>> m_IOQueue;
+    std::vector<boost::thread> m_IOThreads;
+    bool m_bIOStop;
+
+    boost::mutex m_GraphLock;
+    std::map<ICentaurusTask*, centaurus_node> m_Graph;
+
+    boost::mutex m_DoneLock;
+    boost::condition_variable m_DoneCond;
+    std::deque<ICentaurusTask*> m_Done;
 };
 
 #endif
\ No newline at end of file
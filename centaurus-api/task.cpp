@@ -1,15 +1,25 @@
 ﻿#include "task.h"
+#include "job.h"
+#include "scheduler.h"
 #include <json_file.h>
 #include <win32util.h>
 #include <croexception.h>
 #include <crofile.h>
+#include <algorithm>
+#include <thread>
 
 CentaurusTask::CentaurusTask()
     : CentaurusLogger("CentaurusTask", logger),
     m_TaskName("CentaurusTask")
 {
     m_pInvoker = NULL;
+    m_Priority = PriorityExport;
     m_Limit = 0;
+    m_Forked = 0;
+    m_bJoinAwait = false;
+    m_bCancel = false;
+    m_bPause = false;
+    m_Deadline = std::chrono::steady_clock::time_point::max();
 }
 
 CentaurusTask::CentaurusTask(const std::string& taskName)
@@ -17,7 +27,13 @@ CentaurusTask::CentaurusTask(const std::string& taskName)
     m_TaskName(taskName)
 {
     m_pInvoker = NULL;
+    m_Priority = PriorityExport;
     m_Limit = 0;
+    m_Forked = 0;
+    m_bJoinAwait = false;
+    m_bCancel = false;
+    m_bPause = false;
+    m_Deadline = std::chrono::steady_clock::time_point::max();
 }
 
 CentaurusTask::~CentaurusTask()
@@ -29,7 +45,7 @@ void CentaurusTask::Invoke(ICentaurusWorker* invoker)
 {
     m_pInvoker = invoker;
     SetLogForward(m_pInvoker ? m_pInvoker->GetWorkerLogger() : logger);
-    m_Limit = invoker->GetMemoryLimit();
+    if (invoker) m_Limit = invoker->GetMemoryLimit();
 }
 
 void CentaurusTask::RunTask()
@@ -39,7 +55,7 @@ void CentaurusTask::RunTask()
 void CentaurusTask::Release()
 {
     auto lock = boost::mutex::scoped_lock(m_DataLock);
-    for (auto& bank : m_Banks) bank->Disconnect();
+    for (auto& bank : m_Banks) bank->ReleaseLease();
     
     FlushBuffers();
     ReleaseBuffers();
@@ -54,22 +70,116 @@ centaurus_size CentaurusTask::GetMemoryUsage()
     auto lock = boost::mutex::scoped_lock(m_DataLock);
     for (const auto& table : m_Tables)
         total += table->GetSize();
+    for (const auto& sub : m_Subtasks)
+        total += sub->GetMemoryUsage();
     return total;
 }
 
-bool CentaurusTask::AcquireBank(ICentaurusBank* bank)
+centaurus_size CentaurusTask::EstimateMemory()
 {
-    if (centaurus->IsBankAcquired(bank))
+    // unknown, the scheduler falls back to the worker share
+    return 0;
+}
+
+TaskPriority CentaurusTask::GetTaskPriority() const
+{
+    return m_Priority;
+}
+
+void CentaurusTask::SetTaskPriority(TaskPriority priority)
+{
+    m_Priority = priority;
+}
+
+ICentaurusBank* CentaurusTask::TaskBank()
+{
+    auto lock = boost::mutex::scoped_lock(m_DataLock);
+    return m_Banks.empty() ? NULL : m_Banks.front();
+}
+
+void CentaurusTask::CancelTask()
+{
+    {
+        auto lock = boost::mutex::scoped_lock(m_ControlLock);
+        m_bCancel = true;
+    }
+    m_ControlCond.notify_all();
+
+    auto lock = boost::mutex::scoped_lock(m_DataLock);
+    for (const auto& sub : m_Subtasks) sub->CancelTask();
+}
+
+void CentaurusTask::PauseTask()
+{
+    auto lock = boost::mutex::scoped_lock(m_ControlLock);
+    m_bPause = true;
+}
+
+void CentaurusTask::ContinueTask()
+{
+    {
+        auto lock = boost::mutex::scoped_lock(m_ControlLock);
+        m_bPause = false;
+    }
+    m_ControlCond.notify_all();
+}
+
+bool CentaurusTask::IsTaskCancelled() const
+{
+    auto lock = boost::mutex::scoped_lock(m_ControlLock);
+    return m_bCancel;
+}
+
+void CentaurusTask::SetTaskDeadline(
+    std::chrono::steady_clock::time_point deadline)
+{
+    {
+        auto lock = boost::mutex::scoped_lock(m_ControlLock);
+        m_Deadline = deadline;
+    }
+    m_ControlCond.notify_all();
+}
+
+void CentaurusTask::CheckTask()
+{
+    CentaurusJob* job = CentaurusJob::CurrentJob();
+    if (job && job->JobTask() != this) job = NULL;
+
+    for (;;)
+    {
+        // the window is released here, urgent work may take the job
+        while (job && job->RunUrgentTask());
+        CheckCancel();
+
+        boost::unique_lock<boost::mutex> lock(m_ControlLock);
+        if (!m_bPause) return;
+
+        m_ControlCond.wait_for(lock, CENTAURUS_PAUSE_POLL);
+    }
+}
+
+void CentaurusTask::CheckCancel()
+{
+    auto lock = boost::mutex::scoped_lock(m_ControlLock);
+    if (m_bCancel)
+        throw CentaurusCancelled("task cancelled");
+    if (std::chrono::steady_clock::now() >= m_Deadline)
+        throw CentaurusCancelled("task deadline exceeded");
+}
+
+bool CentaurusTask::AcquireBank(ICentaurusBank* bank, BankLease lease)
+{
+    if (IsBankAcquired(bank))
         return false;
-    
-    bool connected = bank->Connect();
-    if (connected)
+
+    bool leased = bank->AcquireLease(lease);
+    if (leased)
     {
         auto lock = boost::mutex::scoped_lock(m_DataLock);
         m_Banks.push_back(bank);
     }
 
-    return connected;
+    return leased;
 }
 
 void CentaurusTask::AcquireTable(CroTable* table)
@@ -137,12 +247,46 @@ void CentaurusTask::ReleaseBuffers()
 }
 
 CroSync* CentaurusTask::CreateSyncFile(const std::wstring& path,
-    cronos_size bufferSize)
+    cronos_size bufferSize, crocodec_type codec, int level, bool direct)
+{
+    // same memory as one buffer of bufferSize, split so that the export
+    // keeps filling while the writer thread is on disk
+    cronos_size asyncSize = std::max<cronos_size>(
+        bufferSize / CROSYNC_ASYNC_BUFFERS, CROSYNC_ALIGN);
+    if (!m_pSyncWriter)
+        m_pSyncWriter = std::make_unique<CroSyncWriter>();
+    if (!CroCodecAvailable(codec))
+        throw std::runtime_error("compression codec is not available");
+
+    // a direct file copies every write into its aligned buffer, room for
+    // a whole async block next to the carried tail keeps writes large
+    CroSync* file = direct
+        ? new CroSyncFile(path, asyncSize + CROSYNC_ALIGN,
+            CROSYNC_PREALLOC | CROSYNC_DIRECT)
+        : new CroSyncFile(path, CROSYNC_ALIGN, CROSYNC_PREALLOC);
+    if (codec != CroCodec_None)
+    {
+        if (!m_pCodecPool)
+            m_pCodecPool = std::make_unique<CroCodecPool>(PoolThreads());
+
+        file = new CroSyncCompress(file, m_pCodecPool.get(), codec,
+            std::min<cronos_size>(asyncSize, CROSYNC_COMPRESS_BLOCK), level);
+    }
+
+    CroSyncAsync* sync = new CroSyncAsync(file, m_pSyncWriter.get(),
+        asyncSize);
+
+    AcquireBuffer(sync);
+    return sync;
+}
+
+unsigned CentaurusTask::PoolThreads() const
 {
-    CroSyncFile* file = new CroSyncFile(path, bufferSize);
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
 
-    AcquireBuffer(file);
-    return file;
+    CentaurusJob* job = CentaurusJob::CurrentJob();
+    if (job) threads /= std::max(job->Scheduler()->PoolSize(), 1u);
+    return std::max(threads, 1u);
 }
 
 ICentaurusWorker* CentaurusTask::Invoker() const
@@ -154,3 +298,136 @@ const std::string& CentaurusTask::TaskName() const
 {
     return m_TaskName;
 }
+
+unsigned CentaurusTask::Fork(cronos_id start, cronos_id end, unsigned parts,
+    CentaurusSubtaskFunc func)
+{
+    if (end <= start) return 0;
+
+    cronos_id count = end - start;
+    if (!parts) parts = 1;
+    if (parts > count) parts = (unsigned)count;
+
+    std::vector<CentaurusSubtask*> spawned;
+    {
+        auto lock = boost::mutex::scoped_lock(m_DataLock);
+        centaurus_size used = 0;
+        for (const auto& table : m_Tables)
+            used += table->GetSize();
+        for (const auto& sub : m_Subtasks)
+            used += sub->Limit();
+
+        centaurus_size limit = used < m_Limit ? (m_Limit - used) / parts : 0;
+        for (unsigned i = 0; i < parts; i++)
+        {
+            auto* sub = new CentaurusSubtask(this, i,
+                start + count * i / parts, start + count * (i + 1) / parts,
+                limit, func);
+
+            m_Subtasks.emplace_back(sub);
+            spawned.push_back(sub);
+        }
+    }
+
+    {
+        auto lock = boost::mutex::scoped_lock(m_JoinLock);
+        m_Forked += parts;
+    }
+
+    CentaurusJob* job = CentaurusJob::CurrentJob();
+    for (auto* sub : spawned)
+    {
+        if (job) job->Scheduler()->ScheduleTask(sub);
+        else
+        {
+            // not on the pool, run in place
+            sub->Invoke(m_pInvoker);
+            sub->RunTask();
+        }
+    }
+
+    return parts;
+}
+
+void CentaurusTask::Join()
+{
+    CentaurusJob* job = CentaurusJob::CurrentJob();
+    boost::unique_lock<boost::mutex> lock(m_JoinLock);
+    while (m_Forked)
+    {
+        lock.unlock();
+        bool helped = job && job->RunLocalTask();
+        lock.lock();
+
+        if (!helped && m_Forked) m_JoinCond.wait(lock);
+    }
+    lock.unlock();
+
+    JoinResult();
+}
+
+void CentaurusTask::JoinResult()
+{
+    std::exception_ptr error;
+    {
+        auto dataLock = boost::mutex::scoped_lock(m_DataLock);
+        for (const auto& sub : m_Subtasks)
+        {
+            if (!error) error = sub->m_Error;
+        }
+        m_Subtasks.clear();
+    }
+
+    if (error) std::rethrow_exception(error);
+}
+
+/* CentaurusSubtask */
+
+CentaurusSubtask::CentaurusSubtask(CentaurusTask* parent, unsigned index,
+    cronos_id start, cronos_id end, centaurus_size limit,
+    CentaurusSubtaskFunc func)
+    : CentaurusTask(parent->TaskName() + "#" + std::to_string(index)),
+    m_pParent(parent), m_Index(index), m_Start(start), m_End(end),
+    m_Func(func)
+{
+    m_Limit = limit;
+    SetTaskPriority(parent->GetTaskPriority());
+
+    auto lock = boost::mutex::scoped_lock(parent->m_ControlLock);
+    m_bCancel = parent->m_bCancel;
+    m_Deadline = parent->m_Deadline;
+}
+
+void CentaurusSubtask::Invoke(ICentaurusWorker* invoker)
+{
+    centaurus_size limit = m_Limit;
+    CentaurusTask::Invoke(invoker);
+    m_Limit = limit;
+}
+
+void CentaurusSubtask::RunTask()
+{
+    try {
+        m_Func(*this);
+    }
+    catch (...) {
+        m_Error = std::current_exception();
+    }
+    Release();
+
+    // the parent may free this subtask as soon as the count drops
+    CentaurusTask* parent = m_pParent;
+    bool resume = false;
+    {
+        auto lock = boost::mutex::scoped_lock(parent->m_JoinLock);
+        if (!--parent->m_Forked && parent->m_bJoinAwait)
+        {
+            parent->m_bJoinAwait = false;
+            resume = true;
+        }
+        else parent->m_JoinCond.notify_all();
+    }
+
+    // a suspended parent stays alive until it is resumed
+    if (resume) parent->Resume();
+}
@@ -6,11 +6,22 @@
 #include "logger.h"
 #include <crosync.h>
 #include <crotable.h>
+#include <exception>
+#include <functional>
+#include <memory>
 #include <utility>
 #include <vector>
 
 #include <boost/atomic.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/chrono.hpp>
+
+// a paused task looks for urgent work and its deadline this often
+#define CENTAURUS_PAUSE_POLL boost::chrono::seconds(1)
+
+class CentaurusSubtask;
+typedef std::function<void(CentaurusSubtask& sub)> CentaurusSubtaskFunc;
 
 class CENTAURUS_API CentaurusTask : public ICentaurusTask, protected CentaurusLogger
 {
@@ -23,8 +34,28 @@ public:
     virtual void RunTask();
     virtual void Release();
     virtual centaurus_size GetMemoryUsage();
+    virtual centaurus_size EstimateMemory();
+    TaskPriority GetTaskPriority() const override;
+    void SetTaskPriority(TaskPriority priority);
+    ICentaurusBank* TaskBank() override;
+
+    void CancelTask() override;
+    void PauseTask() override;
+    void ContinueTask() override;
+    bool IsTaskCancelled() const override;
+    void SetTaskDeadline(
+        std::chrono::steady_clock::time_point deadline) override;
+
+    // Window boundary of a long running task: runs queued tasks of a
+    // more urgent class on this job, waits while paused and throws
+    // CentaurusCancelled once cancelled or past the deadline.
+    void CheckTask();
+    // Inside a window, where memory is still held: only throws
+    // CentaurusCancelled, never yields or waits.
+    void CheckCancel();
     
-    bool AcquireBank(ICentaurusBank* bank) override;
+    bool AcquireBank(ICentaurusBank* bank,
+        BankLease lease = LeaseShared) override;
     CroTable* AcquireTable(CroTable&& table) override;
     bool IsBankAcquired(ICentaurusBank* bank) override;
     void ReleaseTable(CroTable* table) override;
@@ -53,11 +84,29 @@ public:
         return dynamic_cast<CroSync*>(buffer);
     }
 
-    CroSync* CreateSyncFile(const std::wstring& path, cronos_size bufferSize);
+    // Threads a helper pool of this task may keep busy: its job's share
+    // of the hardware threads, all of them off the scheduler pool.
+    unsigned PoolThreads() const;
+
+    // direct bypasses the page cache, see CROSYNC_DIRECT
+    CroSync* CreateSyncFile(const std::wstring& path, cronos_size bufferSize,
+        crocodec_type codec = CroCodec_None,
+        int level = CROCODEC_DEFAULT_LEVEL, bool direct = false);
 
     ICentaurusWorker* Invoker() const override;
     const std::string& TaskName() const override;
 
+    // Splits ids [start, end) into up to parts subtasks on the scheduler
+    // pool, each limited to an equal share of what is left of m_Limit.
+    // Join waits for all of them and rethrows the first failure.
+    unsigned Fork(cronos_id start, cronos_id end, unsigned parts,
+        CentaurusSubtaskFunc func);
+    void Join();
+
+    template<typename T, typename Map, typename Reduce>
+    T ForkJoin(cronos_id start, cronos_id end, unsigned parts, T init,
+        Map map, Reduce reduce);
+
     boost::atomic<float> m_fTaskProgress;
 protected:
     boost::mutex m_DataLock;
@@ -65,10 +114,71 @@ protected:
 
     std::vector<ICentaurusBank*> m_Banks;
     std::vector<std::unique_ptr<CroTable>> m_Tables;
+    std::unique_ptr<CroSyncWriter> m_pSyncWriter;
+    std::unique_ptr<CroCodecPool> m_pCodecPool;
     std::vector<std::unique_ptr<CroSync>> m_Buffers;
+
+    boost::mutex m_JoinLock;
+    boost::condition_variable m_JoinCond;
+    unsigned m_Forked;
+    bool m_bJoinAwait;
+    std::vector<std::unique_ptr<CentaurusSubtask>> m_Subtasks;
+
+    mutable boost::mutex m_ControlLock;
+    boost::condition_variable m_ControlCond;
+    bool m_bCancel;
+    bool m_bPause;
+    std::chrono::steady_clock::time_point m_Deadline;
+
+    // collects the joined subtasks, rethrows the first failure
+    void JoinResult();
+    // called by the last subtask when m_bJoinAwait is set
+    virtual void Resume() {}
 private:
+    friend class CentaurusSubtask;
+
     std::string m_TaskName;
     ICentaurusWorker* m_pInvoker;
+    TaskPriority m_Priority;
 };
 
+class CENTAURUS_API CentaurusSubtask : public CentaurusTask
+{
+public:
+    CentaurusSubtask(CentaurusTask* parent, unsigned index, cronos_id start,
+        cronos_id end, centaurus_size limit, CentaurusSubtaskFunc func);
+
+    void Invoke(ICentaurusWorker* invoker = NULL) override;
+    void RunTask() override;
+
+    inline CentaurusTask* Parent() const { return m_pParent; }
+    inline unsigned Index() const { return m_Index; }
+    inline cronos_id Start() const { return m_Start; }
+    inline cronos_id End() const { return m_End; }
+    inline centaurus_size Limit() const { return m_Limit; }
+
+    std::exception_ptr m_Error;
+private:
+    CentaurusTask* m_pParent;
+    unsigned m_Index;
+    cronos_id m_Start;
+    cronos_id m_End;
+    CentaurusSubtaskFunc m_Func;
+};
+
+template<typename T, typename Map, typename Reduce>
+inline T CentaurusTask::ForkJoin(cronos_id start, cronos_id end,
+    unsigned parts, T init, Map map, Reduce reduce)
+{
+    // one slot per subtask, std::vector<bool> would share words
+    std::unique_ptr<T[]> results(new T[parts ? parts : 1]);
+    unsigned count = Fork(start, end, parts,
+        [&](CentaurusSubtask& sub) { results[sub.Index()] = map(sub); });
+    Join();
+
+    for (unsigned i = 0; i < count; i++)
+        init = reduce(std::move(init), std::move(results[i]));
+    return init;
+}
+
 #endif
\ No newline at end of file
@@ -20,13 +20,19 @@ void CentaurusWorker::Start()
 {
     m_Thread = boost::thread(&CentaurusWorker::Run, this);
 
-    m_State = Running;
+    {
+        auto lock = scoped_lock(m_SyncLock);
+        m_State = Running;
+    }
     m_SyncCond.notify_all();
 }
 
 void CentaurusWorker::Stop()
 {
-    m_State = Terminated;
+    {
+        auto lock = scoped_lock(m_SyncLock);
+        m_State = Terminated;
+    }
     m_SyncCond.notify_all();
 
     m_Thread.interrupt();
@@ -71,17 +77,16 @@ void CentaurusWorker::Run()
         try {
             if (m_State == Waiting)
             {
-                auto lock = scoped_lock(m_SyncLock);
-                m_SyncCond.wait(lock);
-
-                m_State = Running;
+                // Execute blocks on its own queue, waiting is only
+                // left until Start or Stop
+                boost::unique_lock<boost::mutex> lock(m_SyncLock);
+                while (m_State == Waiting)
+                    m_SyncCond.wait(lock);
                 continue;
             }
             else if (m_State == Running)
             {
                 Execute();
-                
-                m_SyncCond.notify_all();
                 centaurus->Sync(this);
             }
         } catch (const boost::thread_interrupted& ti) {
@@ -31,6 +31,7 @@ CentaurusAPI::CentaurusAPI()
 {
     m_MemoryLimit = 0;
     m_WorkerLimit = 0;
+    m_FetchLimit = 0;
 }
 
 CentaurusAPI::~CentaurusAPI()
@@ -48,6 +49,27 @@ void CentaurusAPI::SetWorkerLimit(unsigned threads)
     m_pScheduler->SetPoolSize(m_WorkerLimit);
 }
 
+void CentaurusAPI::SetFetchLimit(unsigned threads)
+{
+    auto lock = scoped_lock(m_FetchLock);
+    m_FetchLimit = threads;
+
+    while (m_Fetch.size() < m_FetchLimit)
+    {
+        CentaurusFetch* fetch = new CentaurusFetch(&m_FetchQueue);
+        m_Fetch.emplace_back(fetch);
+        StartWorker(fetch);
+    }
+
+    while (m_Fetch.size() > m_FetchLimit)
+    {
+        // a busy worker finishes its bank before it stops
+        m_Fetch.back()->Stop();
+        m_Fetch.back()->Wait();
+        m_Fetch.pop_back();
+    }
+}
+
 centaurus_size CentaurusAPI::TotalMemoryUsage()
 {
     auto lock = scoped_lock(m_TaskLock);
@@ -76,14 +98,14 @@ void CentaurusAPI::Init(const std::wstring& path)
     m_WorkerLimit = CENTAURUS_WORKER_LIMIT;
 
     m_pScheduler = CreateWorker<CentaurusScheduler>();
-    m_pFetch = CreateWorker<CentaurusFetch>();
 
     m_pScheduler->SetPoolSize(m_WorkerLimit);
+    SetFetchLimit(CENTAURUS_FETCH_LIMIT);
 }
 
 void CentaurusAPI::Exit()
 {
-    m_pFetch->Stop();
+    SetFetchLimit(0);
     m_pScheduler->Stop();
 
     m_Tasks.clear();
@@ -149,7 +171,24 @@ std::wstring CentaurusAPI::BankFile(ICentaurusBank* bank)
 
 void CentaurusAPI::ConnectBank(const std::wstring& path)
 {
-    m_pFetch->RequestBank(path);
+    m_FetchQueue.RequestBank(path);
+}
+
+void CentaurusAPI::ConnectBank(const std::wstring& path,
+    CentaurusBankCallback callback)
+{
+    m_FetchQueue.RequestBank(path, callback);
+}
+
+void CentaurusAPI::FindBanks(const std::wstring& path,
+    CentaurusBankCallback callback)
+{
+    m_FetchQueue.RequestAll(path, callback);
+}
+
+void CentaurusAPI::WaitFetch()
+{
+    m_FetchQueue.Wait();
 }
 
 void CentaurusAPI::DisconnectBank(ICentaurusBank* bank)
@@ -333,6 +372,12 @@ void CentaurusAPI::TaskSyncJSON(ICentaurusTask* task, json value)
 }
 
 void CentaurusAPI::StartTask(ICentaurusTask* task)
+{
+    StartTask(task, {});
+}
+
+void CentaurusAPI::StartTask(ICentaurusTask* task,
+    const std::vector<ICentaurusTask*>& after)
 {
     Log("StartTask %p\n", task);
     {
@@ -345,7 +390,7 @@ void CentaurusAPI::StartTask(ICentaurusTask* task)
         {"memoryUsage", task->GetMemoryUsage()}
     });
 
-    m_pScheduler->ScheduleTask(task);
+    m_pScheduler->ScheduleTask(task, after);
 }
 
 void CentaurusAPI::ReleaseTask(ICentaurusTask* task)
@@ -371,14 +416,7 @@ bool CentaurusAPI::IsBankLoaded(ICentaurusBank* bank)
 
 bool CentaurusAPI::IsBankAcquired(ICentaurusBank* bank)
 {
-    auto lock = boost::unique_lock<boost::mutex>(m_TaskLock);
-    for (auto& task : m_Tasks)
-    {
-        if (task->IsBankAcquired(bank))
-            return true;
-    }
-
-    return false;
+    return bank->LeaseCount() > 0;
 }
 
 void CentaurusAPI::Run()
@@ -386,37 +424,51 @@ void CentaurusAPI::Run()
     m_pScheduler->Wait();
 }
 
-void CentaurusAPI::Sync(ICentaurusWorker* worker)
+void CentaurusAPI::SyncFetch(CentaurusFetch* fetch)
 {
-    auto lock = scoped_lock(m_SyncLock);
-    auto* _worker = dynamic_cast<CentaurusWorker*>(worker);
-    
-    if (worker == m_pFetch.get())
+    std::wstring dir = fetch->m_LoadedPath;
+    ICentaurusBank* bank = fetch->m_pLoadedBank;
+    CentaurusBankCallback callback = std::move(fetch->m_LoadedCallback);
+
+    fetch->m_LoadedPath = L"";
+    fetch->m_pLoadedBank = NULL;
+    fetch->m_LoadedCallback = nullptr;
+    if (dir.empty()) return;
+
     {
+        auto lock = scoped_lock(m_SyncLock);
         auto bankLock = scoped_lock(m_BankLock);
-        
-        std::wstring dir = m_pFetch->m_LoadedPath;
-        ICentaurusBank* bank = m_pFetch->m_pLoadedBank;
-
-        m_pFetch->m_LoadedPath = L"";
-        m_pFetch->m_pLoadedBank = NULL;
 
         if (bank)
         {
             m_Banks.emplace_back(bank);
             Log("Loaded bank \"%s\"\n", WcharToTerm(dir).c_str());
         }
-        else if (!dir.empty())
+        else
         {
             m_FailedBanks.push_back(dir);
             Error("Failed to load bank at \"%s\"\n",
                 WcharToTerm(dir).c_str());
         }
     }
-
     m_SyncCond.notify_all();
-    //fprintf(m_fOutput, "[CentaurusAPI] Sync %s\n",
-    //    _worker->GetName().c_str());
+
+    // outside of the locks, the callback may schedule tasks
+    try {
+        if (callback) callback(dir, bank);
+    } catch (const std::exception& e) {
+        OnException(e);
+    }
+
+    m_FetchQueue.Done();
+}
+
+void CentaurusAPI::Sync(ICentaurusWorker* worker)
+{
+    // only a fetched bank is an event for the API, jobs and the
+    // scheduler report completions through their own queues
+    auto* fetch = dynamic_cast<CentaurusFetch*>(worker);
+    if (fetch) SyncFetch(fetch);
 }
 
 void CentaurusAPI::OnException(const std::exception& exc)
@@ -18,6 +18,7 @@
 
 #define CENTAURUS_MEMORY_LIMIT (512*1024*1024)
 #define CENTAURUS_WORKER_LIMIT 4
+#define CENTAURUS_FETCH_LIMIT 4
 
 class CentaurusAPI : public ICentaurusAPI, public CentaurusLogger
 {
@@ -30,6 +31,7 @@ public:
 
     void SetMemoryLimit(centaurus_size limit) override;
     void SetWorkerLimit(unsigned threads) override;
+    void SetFetchLimit(unsigned threads) override;
     centaurus_size TotalMemoryUsage() override;
     centaurus_size GetMemoryLimit() override;
     centaurus_size GetWorkerMemoryLimit() override;
@@ -50,6 +52,11 @@ public:
 
     std::wstring BankFile(ICentaurusBank* bank) override;
     void ConnectBank(const std::wstring& path) override;
+    void ConnectBank(const std::wstring& path,
+        CentaurusBankCallback callback) override;
+    void FindBanks(const std::wstring& path,
+        CentaurusBankCallback callback) override;
+    void WaitFetch() override;
     void DisconnectBank(ICentaurusBank* bank) override;
     ICentaurusBank* FindBank(const std::wstring& path) override;
     ICentaurusBank* WaitBank(const std::wstring& path) override;
@@ -62,6 +69,8 @@ public:
     std::wstring TaskFile(ICentaurusTask* task) override;
     void TaskSyncJSON(ICentaurusTask* task, json value);
     void StartTask(ICentaurusTask* task) override;
+    void StartTask(ICentaurusTask* task,
+        const std::vector<ICentaurusTask*>& after) override;
     void ReleaseTask(ICentaurusTask* task);
     
     void Run() override;
@@ -71,6 +80,7 @@ public:
         const std::exception& exc) override;
 
     std::string SizeToString(centaurus_size size) const;
+    void SyncFetch(CentaurusFetch* fetch);
 
     bool IsBankExported(uint32_t bankId) override;
     void UpdateBankExportIndex(uint32_t bankId,
@@ -78,11 +88,14 @@ public:
 private:
     centaurus_size m_MemoryLimit;
     unsigned m_WorkerLimit;
+    unsigned m_FetchLimit;
     std::wstring m_DataPath;
 
     boost::mutex m_BankLock;
     std::vector<std::unique_ptr<ICentaurusBank>> m_Banks;
-    std::unique_ptr<CentaurusFetch> m_pFetch;
+    CentaurusFetchQueue m_FetchQueue;
+    boost::mutex m_FetchLock;
+    std::vector<std::unique_ptr<CentaurusFetch>> m_Fetch;
 
     boost::mutex m_TaskLock;
     std::vector<std::unique_ptr<ICentaurusTask>> m_Tasks;
@@ -1,13 +1,18 @@
 ﻿#include "bank.h"
 #include "export.h"
 #include <crostru.h>
+#include <crorow.h>
+#include <croblob.h>
 #include <stdexcept>
 #include <fstream>
+#include <string.h>
+#include <stdio.h>
 
 #include <win32util.h>
 #include <boost/json.hpp>
 #include <boost/locale.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
 namespace fs = boost::filesystem;
 namespace sc = boost::system;
 
@@ -17,6 +22,9 @@ CentaurusBank::CentaurusBank()
     : CroBank(L"")
 {
     m_pCronos = NULL;
+    m_Leases = 0;
+    m_bExclusive = false;
+    m_BlockSize = 0;
 }
 
 CentaurusBank::~CentaurusBank()
@@ -64,11 +72,50 @@ void CentaurusBank::Disconnect()
     Bank()->Close();
 }
 
+bool CentaurusBank::AcquireLease(BankLease lease)
+{
+    auto lock = boost::mutex::scoped_lock(m_LeaseLock);
+    if (m_bExclusive || (lease == LeaseExclusive && m_Leases))
+        return false;
+
+    // files are opened by the first holder and shared by the rest,
+    // reopening them under a reader would pull them away
+    if (!m_Leases && !Connect())
+    {
+        Disconnect();
+        return false;
+    }
+
+    m_Leases++;
+    m_bExclusive = lease == LeaseExclusive;
+    return true;
+}
+
+void CentaurusBank::ReleaseLease()
+{
+    auto lock = boost::mutex::scoped_lock(m_LeaseLock);
+    if (!m_Leases) return;
+
+    if (!--m_Leases)
+    {
+        m_bExclusive = false;
+        Disconnect();
+    }
+}
+
+unsigned CentaurusBank::LeaseCount() const
+{
+    auto lock = boost::mutex::scoped_lock(m_LeaseLock);
+    return m_Leases;
+}
+
 void CentaurusBank::Load(ICronosAPI* cro)
 {
     m_pCronos = cro;
 
     LoadStructure();
+    CroFile* file = File(CROFILE_BANK);
+    if (file) m_BlockSize = file->GetDefaultBlockSize();
 
     m_pCronos = NULL;
 }
@@ -84,10 +131,99 @@ void CentaurusBank::LoadStructure()
     uint32_t key = file->GetSecretKey(file->GetSecret());
     file->SetupCrypt(key, CRONOS_DEFAULT_SERIAL);
 
+    if (LoadStructureCache()) return;
+
     auto stru = file->LoadRecordMap(1, file->EntryCountFileSize());
     auto parser = CroStruParser(Bank(), &stru);
 
     parser.LoadBankProps();
+    SaveStructureCache();
+}
+
+std::wstring CentaurusBank::StructureCachePath() const
+{
+    std::string path = WcharToText(GetBankPath());
+    CroHash64 hash;
+    hash.Update((const uint8_t*)path.data(), path.size());
+
+    char szName[32];
+    sprintf(szName, "%016llx.stru", (unsigned long long)hash.Digest());
+    return JoinFilePath(centaurus->GetBankPath(), TextToWchar(szName));
+}
+
+std::vector<uint8_t> CentaurusBank::StructureStamp()
+{
+    // bank path, then size, mtime and header hash of STRU .dat and .tad
+    std::vector<uint8_t> stamp;
+    std::string path = WcharToText(GetBankPath());
+    CroRowString(stamp, path.data(), path.size());
+
+    std::wstring stru = File(CROFILE_STRU)->GetPath();
+    for (const wchar_t* ext : { L".dat", L".tad" })
+    {
+        fs::path file = stru + ext;
+        CroRowVarint(stamp, fs::file_size(file));
+        CroRowVarint(stamp, (uint64_t)fs::last_write_time(file));
+
+        uint8_t header[CENTAURUS_STRU_CACHE_HEADER];
+        fs::ifstream in(file, std::ios::binary);
+        in.read((char*)header, sizeof(header));
+
+        CroHash64 hash;
+        hash.Update(header, (cronos_size)in.gcount());
+        CroRowVarint(stamp, hash.Digest());
+    }
+
+    return stamp;
+}
+
+bool CentaurusBank::LoadStructureCache()
+{
+    std::vector<uint8_t> data;
+    try {
+        fs::ifstream in(fs::path(StructureCachePath()), std::ios::binary);
+        if (!in) return false;
+
+        data.assign(std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>());
+
+        const uint8_t* cur = data.data();
+        const uint8_t* end = data.data() + data.size();
+        uint64_t size = CroRowReadVarint(cur, end);
+        if (size > (uint64_t)(end - cur)) return false;
+
+        std::vector<uint8_t> stamp = StructureStamp();
+        if (stamp.size() != size || memcmp(stamp.data(), cur, size))
+            return false;
+        cur += size;
+
+        return RestoreStructure(cur, (cronos_size)(end - cur));
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+void CentaurusBank::SaveStructureCache()
+{
+    try {
+        std::vector<uint8_t> stamp = StructureStamp();
+        std::vector<uint8_t> data;
+        CroRowVarint(data, stamp.size());
+        data.insert(data.end(), stamp.begin(), stamp.end());
+        StoreStructure(data);
+
+        fs::path path = StructureCachePath();
+        fs::path tmpPath = path.wstring() + L".tmp";
+        {
+            fs::ofstream out(tmpPath, std::ios::binary);
+            out.write((const char*)data.data(), data.size());
+            if (!out) throw std::runtime_error("failed to write structure cache");
+        }
+
+        fs::rename(tmpPath, path);
+    } catch (const std::exception& exc) {
+        centaurus->OnException(exc);
+    }
 }
 
 uint32_t CentaurusBank::BankFormSaveVer() const
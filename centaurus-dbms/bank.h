@@ -6,10 +6,14 @@
 #include <crostru.h>
 #include <crobank.h>
 
+#include <boost/thread/mutex.hpp>
+
 #include <utility>
 #include <vector>
 #include <string>
 
+#define CENTAURUS_STRU_CACHE_HEADER 4096
+
 class CroRecordMap;
 
 class CentaurusBank : public CroBank, public ICentaurusBank
@@ -29,8 +33,15 @@ public:
     bool Connect() override;
     void Disconnect() override;
 
+    bool AcquireLease(BankLease lease) override;
+    void ReleaseLease() override;
+    unsigned LeaseCount() const override;
+
     void Load(ICronosAPI* cro) override;
     void LoadStructure();
+    // default block size of the data file, kept from the load for
+    // estimates made while no lease holds the files open
+    inline cronos_size BankBlockSize() const { return m_BlockSize; }
     
     uint32_t BankFormSaveVer() const override;
     uint32_t BankId() const override;
@@ -44,7 +55,17 @@ public:
     CroBase& Base(unsigned index) override;
     unsigned BaseEnd() const override;
 private:
+    std::wstring StructureCachePath() const;
+    std::vector<uint8_t> StructureStamp();
+    bool LoadStructureCache();
+    void SaveStructureCache();
+
     ICronosAPI* m_pCronos;
+
+    mutable boost::mutex m_LeaseLock;
+    unsigned m_Leases;
+    bool m_bExclusive;
+    cronos_size m_BlockSize;
 };
 
 #endif
\ No newline at end of file
@@ -25,10 +25,12 @@ CENTAURUS_DBMS_API ICentaurusAPI* CentaurusDBMS_GetAPI()
 }
 
 CENTAURUS_DBMS_API ICentaurusTask* CentaurusDBMS_TaskExport(
-    ICentaurusBank* bank)
+    ICentaurusBank* bank, ExportFormat fmt, ExportCompression comp, int level)
 {
     CentaurusExport* exp = new CentaurusExport();
-    exp->LoadBank(bank);
+    exp->SetBank(bank);
+    exp->SetExportFormat(fmt);
+    exp->SetExportCompression(comp, level);
 
     return exp;
 }
@@ -23,6 +23,8 @@ CENTAURUS_DBMS_API void CentaurusDBMS_DestroyAPI();
 CENTAURUS_DBMS_API ICentaurusAPI* CentaurusDBMS_GetAPI();
 
 //CENTAURUS_DBMS_API ICentaurusTask* CentaurusTask_Run(CentaurusRun run);
-CENTAURUS_DBMS_API ICentaurusTask* CentaurusDBMS_TaskExport(ICentaurusBank* bank);
+CENTAURUS_DBMS_API ICentaurusTask* CentaurusDBMS_TaskExport(ICentaurusBank* bank,
+    ExportFormat fmt = ExportCSV, ExportCompression comp = CompressNone,
+    int level = -1);
 
 #endif
\ No newline at end of file
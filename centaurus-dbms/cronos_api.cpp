@@ -1,6 +1,10 @@
 #include "cronos_api.h"
 #include <crofile.h>
 #include <crobank.h>
+#include <win32util.h>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
 
 CronosAPI::CronosAPI()
     : CentaurusTask("CronosAPI")
@@ -8,6 +12,7 @@ CronosAPI::CronosAPI()
     m_pBank = NULL;
     m_pFile = NULL;
     m_pMap = NULL;
+    m_Lease = LeaseShared;
 
     m_BlockLimit = 0;
     m_ExportLimit = 0;
@@ -19,6 +24,7 @@ CronosAPI::CronosAPI(const std::string& taskName)
     m_pBank = NULL;
     m_pFile = NULL;
     m_pMap = NULL;
+    m_Lease = LeaseShared;
 
     m_BlockLimit = 0;
     m_ExportLimit = 0;
@@ -28,6 +34,15 @@ void CronosAPI::Invoke(ICentaurusWorker* invoker)
 {
     CentaurusTask::Invoke(invoker);
 
+    // a bank set without a lease opens its files now, RunTask fails when
+    // the lease could not be taken
+    if (!m_pBank) return;
+    if (!IsBankAcquired(m_pBank))
+    {
+        if (!AcquireBank(m_pBank, m_Lease)) return;
+        SetLoaderFile(CROFILE_STRU);
+    }
+
     //m_BlockLimit = m_Limit / m_pBank->
     CroFile* file = m_pBank->BankFile(CROFILE_BANK);
 
@@ -40,6 +55,26 @@ void CronosAPI::Invoke(ICentaurusWorker* invoker)
     m_ExportLimit = count * partSize;
 }
 
+centaurus_size CronosAPI::EstimateMemory()
+{
+    // queued tasks hold no lease, read the sizes without opening the bank
+    cronos_size blockSize = m_pBank ? m_pBank->BankBlockSize() : 0;
+    if (!blockSize) return 0;
+
+    boost::system::error_code ec;
+    cronos_size datSize = (cronos_size)boost::filesystem::file_size(
+        JoinFilePath(m_pBank->GetBankPath(),
+            m_pBank->FileName(CROFILE_BANK)) + L".dat", ec);
+    if (ec) return 0;
+
+    // Invoke spends half of the limit on block windows, the whole data
+    // file in one window needs twice its size
+    cronos_size count = std::max<cronos_size>(
+        (datSize + blockSize - 1) / blockSize, CRONOS_API_MIN_BLOCKS);
+
+    return 2 * count * blockSize;
+}
+
 void CronosAPI::RunTask()
 {
 }
@@ -49,17 +84,24 @@ void CronosAPI::Release()
     ReleaseMap();
 }
 
-void CronosAPI::LoadBank(ICentaurusBank* bank)
+void CronosAPI::LoadBank(ICentaurusBank* bank, BankLease lease)
 {
-    if (!AcquireBank(bank))
+    if (!AcquireBank(bank, lease))
     {
         throw std::runtime_error("failed to load bank");
     }
 
     m_pBank = dynamic_cast<CentaurusBank*>(bank);
+    m_Lease = lease;
     SetLoaderFile(CROFILE_STRU);
 }
 
+void CronosAPI::SetBank(ICentaurusBank* bank, BankLease lease)
+{
+    m_pBank = dynamic_cast<CentaurusBank*>(bank);
+    m_Lease = lease;
+}
+
 CroFile* CronosAPI::SetLoaderFile(crobank_file ftype)
 {
     m_pFile = m_pBank->Bank()->File(ftype);
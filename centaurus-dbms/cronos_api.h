@@ -8,6 +8,8 @@
 #include <crorecord.h>
 #include <crosync.h>
 
+#define CRONOS_API_MIN_BLOCKS 16
+
 class CronosAPI : public CentaurusTask, public ICronosAPI
 {
 public:
@@ -15,11 +17,16 @@ public:
     CronosAPI(const std::string& taskName);
 
     virtual void Invoke(ICentaurusWorker* invoker = NULL);
+    centaurus_size EstimateMemory() override;
     
     void RunTask() override;
     void Release() override;
 
-    virtual void LoadBank(ICentaurusBank* bank);
+    virtual void LoadBank(ICentaurusBank* bank,
+        BankLease lease = LeaseShared);
+    // like LoadBank, but the lease is only taken on Invoke, so a queued
+    // task keeps no files open
+    void SetBank(ICentaurusBank* bank, BankLease lease = LeaseShared);
     virtual CroFile* SetLoaderFile(crobank_file ftype);
     virtual ICentaurusBank* TargetBank() const override;
     virtual CroBank* Bank() const override;
@@ -35,6 +42,7 @@ protected:
     CentaurusBank* m_pBank;
     CroFile* m_pFile;
     CroRecordMap* m_pMap;
+    BankLease m_Lease;
 
     centaurus_size m_BlockLimit;
     centaurus_size m_ExportLimit;
@@ -1,4 +1,11 @@
 ﻿#include "export.h"
+#include <croarrow.h>
+#include <croparquet.h>
+#include <cropostgres.h>
+#include <crosqlite.h>
+#include <croparallel.h>
+#include <crodelta.h>
+#include <time.h>
 #include <win32util.h>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string/trim.hpp>
@@ -11,6 +18,13 @@ CentaurusExport::CentaurusExport()
     : CronosAPI("CentaurusExport")
 {
     m_ExportFormat = ExportCSV;
+    m_ExportCompression = CompressNone;
+    m_CompressLevel = CROCODEC_DEFAULT_LEVEL;
+
+    m_bExportDelta = false;
+    m_bDeltaHash = false;
+    m_bExportDirect = false;
+    m_bDeltaRun = false;
 }
 
 CentaurusExport::~CentaurusExport()
@@ -32,9 +46,70 @@ void CentaurusExport::SetExportFormat(ExportFormat fmt)
     m_ExportFormat = fmt;
 }
 
+ExportCompression CentaurusExport::GetExportCompression() const
+{
+    return m_ExportCompression;
+}
+
+void CentaurusExport::SetExportCompression(ExportCompression comp, int level)
+{
+    m_ExportCompression = comp;
+    m_CompressLevel = level;
+}
+
+bool CentaurusExport::IsExportDelta() const
+{
+    return m_bExportDelta;
+}
+
+void CentaurusExport::SetExportDelta(bool delta, bool hash)
+{
+    m_bExportDelta = delta;
+    m_bDeltaHash = hash;
+}
+
+bool CentaurusExport::IsExportDirect() const
+{
+    return m_bExportDirect;
+}
+
+void CentaurusExport::SetExportDirect(bool direct)
+{
+    m_bExportDirect = direct;
+}
+
 void CentaurusExport::SyncBankJson()
 {
-    WriteJSONFile(JoinFilePath(m_ExportPath, L"bank.json"), m_BankJson);
+    WriteJSONFile(JoinFilePath(m_OutputPath, L"bank.json"), m_BankJson);
+}
+
+ICroExport* CentaurusExport::CreateExport(crocodec_type codec,
+    const std::wstring& sqliteName)
+{
+    switch (m_ExportFormat)
+    {
+    case ExportCSV:
+        return new CroExportCSV(m_pBank);
+    case ExportArrow:
+        return new CroExportArrow(m_pBank);
+    case ExportParquet:
+        return codec != CroCodec_None
+            ? new CroExportParquet(m_pBank, codec)
+            : new CroExportParquet(m_pBank);
+    case ExportPostgres:
+        return new CroExportPostgres(m_pBank);
+    case ExportSQLite:
+#ifdef CRONOS_SQLITE
+        return new CroExportSQLite(m_pBank,
+            JoinFilePath(m_OutputPath, sqliteName));
+#else
+        throw std::runtime_error("built without SQLite support");
+#endif
+    case ExportJSON:
+    case ExportRaw:
+    default:
+        return new CroExportRaw(m_pBank);
+    }
 }
 
 void CentaurusExport::PrepareDirs()
@@ -49,6 +124,7 @@ void CentaurusExport::PrepareDirs()
 
     boost::algorithm::trim(dirName);
     m_ExportPath = JoinFilePath(centaurus->GetExportPath(), dirName);
+    m_OutputPath = m_ExportPath;
     m_FilePath = JoinFilePath(m_ExportPath, L"file");
 
     fs::create_directory(m_ExportPath);
@@ -57,17 +133,61 @@ void CentaurusExport::PrepareDirs()
 
 void CentaurusExport::RunTask()
 {
-    AcquireBank(m_pBank);
+    if (!IsBankAcquired(m_pBank))
+        throw std::runtime_error("failed to load bank");
     PrepareDirs();
 
-    switch (m_ExportFormat)
+    crocodec_type codec = CroCodec_None;
+    std::wstring codecExt;
+    switch (m_ExportCompression)
     {
-    case ExportCSV:
-        m_Export = std::make_unique<CroExportCSV>(m_pBank);
-        break;
-    case ExportJSON:
-    default:
-        m_Export = std::make_unique<CroExportRaw>(m_pBank);
+    case CompressNone: break;
+    case CompressGzip: codec = CroCodec_Gzip; codecExt = L".gz"; break;
+    case CompressZstd: codec = CroCodec_Zstd; codecExt = L".zst"; break;
+    }
+
+    // a delta run needs the fingerprints of the previous export and
+    // writes insert, update and delete files into a directory of its own
+    m_PrevIndex = CroDeltaIndex(m_bDeltaHash);
+    m_bDeltaRun = m_bExportDelta && m_PrevIndex.Load(
+        JoinFilePath(m_ExportPath, CRODELTA_INDEX_FILE));
+    m_DeleteOutputs.clear();
+    m_Outputs.clear();
+
+    // an interrupted run of the same kind continues at its checkpoint
+    m_Index = CroDeltaIndex(m_bDeltaHash);
+    if (LoadCheckpoint())
+    {
+        Log("resuming at record %" FCroId "\n",
+            m_Checkpoint["map_id"].get<cronos_id>());
+        if (m_bDeltaRun)
+        {
+            m_OutputPath = JoinFilePath(m_ExportPath, TextToWchar(
+                m_Checkpoint["output"].get<std::string>()));
+        }
+    }
+    else if (m_bDeltaRun)
+    {
+        char szStamp[32];
+        time_t now = time(NULL);
+        strftime(szStamp, sizeof(szStamp), "delta-%Y%m%dT%H%M%S",
+            gmtime(&now));
+
+        m_OutputPath = JoinFilePath(m_ExportPath, TextToWchar(szStamp));
+        fs::create_directory(m_OutputPath);
+    }
+
+    m_Export.reset(CreateExport(codec, m_bDeltaRun
+        ? CENTAURUS_DELTA_INSERT L".sqlite" : CROSQLITE_BANK_FILE));
+    if (m_bDeltaRun)
+        m_UpdateExport.reset(CreateExport(codec,
+            CENTAURUS_DELTA_UPDATE L".sqlite"));
+
+    if (m_ExportFormat == ExportParquet)
+    {
+        // parquet compresses its pages itself
+        codec = CroCodec_None;
+        codecExt.clear();
     }
 
     m_BankJson = {
@@ -78,13 +198,35 @@ void CentaurusExport::RunTask()
         {"version", m_pBank->BankVersion()},
         {"bases", json::array()}
     };
+    if (m_bDeltaRun)
+        m_BankJson["delta"] = WcharToText(m_ExportPath);
 
     auto& bankBases = m_BankJson["bases"];
     SyncBankJson();
 
+    std::exception_ptr cancelled;
     try {
+        // attached files of all banks share one content addressed store,
+        // created on disk by the first attachment exported
+        m_pBlobStore = std::make_unique<CroBlobStore>(
+            JoinFilePath(centaurus->GetExportPath(), CENTAURUS_BLOB_DIR),
+            JoinFilePath(m_FilePath, CROBLOB_INDEX_FILE));
+
         m_Export->SetFilePath(m_FilePath);
+        m_Export->SetBlobStore(m_pBlobStore.get());
+        if (m_UpdateExport)
+        {
+            m_UpdateExport->SetFilePath(m_FilePath);
+            m_UpdateExport->SetBlobStore(m_pBlobStore.get());
+        }
         cronos_size baseLimit = m_ExportLimit / m_pBank->BaseCount();
+        if (m_bDeltaRun)
+        {
+            // insert, update and delete files share the budget
+            baseLimit /= 3;
+            m_UpdateExport->SetExportLimit(baseLimit);
+        }
+        m_Export->SetExportLimit(baseLimit);
 
         for (auto it = m_pBank->StartBase(); it != m_pBank->EndBase(); it++)
         {
@@ -105,13 +247,38 @@ void CentaurusExport::RunTask()
             {
             case ExportCSV: exportExt = L".csv"; break;
             case ExportJSON: exportExt = L".json"; break;
+            case ExportArrow: exportExt = L".arrow"; break;
+            case ExportParquet: exportExt = L".parquet"; break;
+            case ExportRaw: exportExt = L".crorow"; break;
+            case ExportPostgres: exportExt = L".pgcopy"; break;
+            // the SQLite exporter names its own database file
+            case ExportSQLite: break;
+            }
+
+            std::wstring baseName = L"base"
+                + std::to_wstring(it->m_BaseIndex);
+            std::wstring exportName = baseName + exportExt + codecExt;
+            std::wstring updateName, deleteName;
+            if (m_bDeltaRun)
+            {
+                exportName = baseName + L"." CENTAURUS_DELTA_INSERT
+                    + exportExt + codecExt;
+                updateName = baseName + L"." CENTAURUS_DELTA_UPDATE
+                    + exportExt + codecExt;
+                deleteName = baseName + L"." CENTAURUS_DELTA_DELETE
+                    L".csv" + codecExt;
+            }
+
+            if (m_ExportFormat == ExportSQLite)
+            {
+                exportName = m_bDeltaRun
+                    ? CENTAURUS_DELTA_INSERT L".sqlite" : CROSQLITE_BANK_FILE;
+                updateName = CENTAURUS_DELTA_UPDATE L".sqlite";
             }
+            std::wstring exportPath = JoinFilePath(m_OutputPath, exportName);
 
-            std::wstring exportName = L"base"
-                + std::to_wstring(it->m_BaseIndex) + exportExt;
-            std::wstring exportPath = JoinFilePath(m_ExportPath, exportName);
-            
-            if (fs::exists(exportPath))
+            // stream outputs are cut back or removed as they are opened
+            if (m_ExportFormat == ExportSQLite && fs::exists(exportPath))
             {
                 fs::remove(exportPath);
             }
@@ -123,11 +290,47 @@ void CentaurusExport::RunTask()
                 {"fields", baseFields},
             };
 
+            if (m_ExportFormat == ExportPostgres)
+            {
+                std::wstring sqlName = L"base"
+                    + std::to_wstring(it->m_BaseIndex) + L".sql";
+                std::string sql = CroExportPostgres::CreateTable(&*it,
+                    m_pBank->GetTextCodePage());
+
+                FILE* fSql = _wfopen(JoinFilePath(m_OutputPath,
+                    sqlName).c_str(), L"wb");
+                if (fSql)
+                {
+                    fwrite(sql.data(), sql.size(), 1, fSql);
+                    fclose(fSql);
+
+                    bankBase["create"] = WcharToText(sqlName);
+                }
+            }
+
             json baseExport = json::object();
             try {
-                CroSync* baseOut = CreateSyncFile(exportPath, baseLimit);
+                // SQLite tables are filled by the exporter itself
+                if (m_ExportFormat != ExportSQLite)
+                {
+                    SetOutput(m_Export.get(), it->m_BaseIndex, exportName,
+                        baseLimit, codec);
+                    if (m_bDeltaRun)
+                    {
+                        SetOutput(m_UpdateExport.get(), it->m_BaseIndex,
+                            updateName, baseLimit, codec);
+                    }
+                }
+
+                if (m_bDeltaRun)
+                {
+                    m_DeleteOutputs[it->m_BaseIndex] = OpenOutput(deleteName,
+                        baseLimit, codec);
+
+                    baseExport["update"] = WcharToText(updateName);
+                    baseExport["delete"] = WcharToText(deleteName);
+                }
 
-                m_Export->SetIdentOutput(it->m_BaseIndex, baseOut);
                 Log("%03u\t\"%s\" -> %s\n", it->m_BaseIndex, WcharToTerm(
                     TextToWchar(it->GetName())).c_str(),
                     WcharToTerm(exportPath).c_str()
@@ -135,6 +338,8 @@ void CentaurusExport::RunTask()
 
                 baseExport["file"] = WcharToText(exportName);
                 baseExport["format"] = (unsigned)m_Export->GetExportFormat();
+                if (codec != CroCodec_None)
+                    baseExport["compression"] = WcharToText(codecExt.substr(1));
                 baseExport["status"] = true;
             }
             catch (const std::exception& e) {
@@ -156,6 +361,15 @@ void CentaurusExport::RunTask()
 
             bankExport["status"] = true;
         }
+        catch (const CentaurusCancelled& e) {
+            // the checkpoint stays, a later run resumes from it
+            cancelled = std::current_exception();
+            bankExport["status"] = false;
+            bankExport["error"] = {
+                {"exception", "CentaurusCancelled" },
+                {"what", e.what()}
+            };
+        }
         catch (CroException& ce) {
             centaurus->OnException(ce);
             bankExport["status"] = false;
@@ -177,6 +391,18 @@ void CentaurusExport::RunTask()
         // !! FINISH EXPORT !!
         m_BankJson["export"] = bankExport;
         ReleaseBuffers();
+        m_DeleteOutputs.clear();
+        m_Outputs.clear();
+
+        // fingerprints only once the data they describe is on disk
+        if (bankExport["status"].get<bool>())
+        {
+            m_Index.Save(JoinFilePath(m_ExportPath, CRODELTA_INDEX_FILE));
+            m_pBlobStore->Save();
+
+            fs::remove(JoinFilePath(m_ExportPath, CENTAURUS_CHECKPOINT_FILE));
+            fs::remove(JoinFilePath(m_ExportPath, CENTAURUS_CHECKPOINT_INDEX));
+        }
     }
     catch (CroException& ce) {
         centaurus->OnException(ce);
@@ -197,6 +423,9 @@ void CentaurusExport::RunTask()
     m_BankJson["status"] = !m_BankJson.contains("error");
     SyncBankJson();
 
+    // tasks scheduled after a cancelled export are skipped
+    if (cancelled) std::rethrow_exception(cancelled);
+
     /*{
         auto file = SetLoaderFile(CROFILE_BANK);
         CroExportList list = CroExportList(m_pBank,
@@ -220,10 +449,186 @@ void CentaurusExport::RunTask()
 void CentaurusExport::Release()
 {
     m_Export = NULL;
+    m_UpdateExport = NULL;
+    m_DeleteOutputs.clear();
+    m_Outputs.clear();
+    m_pBlobStore = NULL;
 
     CronosAPI::Release();
 }
 
+bool CentaurusExport::LoadCheckpoint()
+{
+    m_Checkpoint = nullptr;
+
+    std::wstring path = JoinFilePath(m_ExportPath, CENTAURUS_CHECKPOINT_FILE);
+    if (!fs::exists(path)) return false;
+
+    try {
+        json checkpoint = ReadJSONFile(path);
+        if (checkpoint["format"].get<int>() != m_ExportFormat
+            || checkpoint["compression"].get<int>() != m_ExportCompression
+            || checkpoint["delta"].get<bool>() != m_bDeltaRun
+            || checkpoint["hash"].get<bool>() != m_bDeltaHash)
+        {
+            return false;
+        }
+
+        std::wstring outputPath = m_ExportPath;
+        if (m_bDeltaRun)
+        {
+            outputPath = JoinFilePath(m_ExportPath, TextToWchar(
+                checkpoint["output"].get<std::string>()));
+        }
+
+        // every output has to hold at least what was checkpointed
+        for (auto& [name, offset] : checkpoint["files"].items())
+        {
+            std::wstring file = JoinFilePath(outputPath, TextToWchar(name));
+            if (!fs::exists(file)
+                || fs::file_size(file) < offset.get<uintmax_t>())
+            {
+                return false;
+            }
+        }
+
+        if (!m_Index.Load(JoinFilePath(m_ExportPath,
+            CENTAURUS_CHECKPOINT_INDEX)))
+        {
+            m_Index = CroDeltaIndex(m_bDeltaHash);
+            return false;
+        }
+
+        // the index may be ahead of the checkpoint it was saved for
+        cronos_id map_id = checkpoint["map_id"].get<cronos_id>();
+        for (cronos_id id = map_id; id < m_Index.IdEnd(); id++)
+            m_Index.RemoveEntry(id);
+
+        m_Checkpoint = checkpoint;
+    }
+    catch (const std::exception& e) {
+        Error("checkpoint: %s\n", e.what());
+        m_Index = CroDeltaIndex(m_bDeltaHash);
+        return false;
+    }
+
+    return true;
+}
+
+void CentaurusExport::Checkpoint(cronos_id map_id)
+{
+    json files = json::object();
+    for (auto& [name, out] : m_Outputs)
+        files[WcharToText(name)] = out->Checkpoint();
+
+    m_Index.Save(JoinFilePath(m_ExportPath, CENTAURUS_CHECKPOINT_INDEX));
+    m_pBlobStore->Save();
+
+    json checkpoint = {
+        {"map_id", map_id},
+        {"format", m_ExportFormat},
+        {"compression", m_ExportCompression},
+        {"delta", m_bDeltaRun},
+        {"hash", m_bDeltaHash},
+        {"output", m_bDeltaRun ? WcharToText(
+            fs::path(m_OutputPath).filename().wstring()) : ""},
+        {"files", files}
+    };
+
+    // the checkpoint file is replaced last, it is what makes it valid
+    std::wstring path = JoinFilePath(m_ExportPath, CENTAURUS_CHECKPOINT_FILE);
+    WriteJSONFile(path + L".tmp", checkpoint);
+    fs::rename(path + L".tmp", path);
+}
+
+bool CentaurusExport::IsResumed(const std::wstring& name) const
+{
+    return m_Checkpoint.is_object()
+        && m_Checkpoint.at("files").contains(WcharToText(name));
+}
+
+CroSync* CentaurusExport::OpenOutput(const std::wstring& name,
+    cronos_size bufferSize, crocodec_type codec)
+{
+    std::wstring path = JoinFilePath(m_OutputPath, name);
+    if (IsResumed(name))
+    {
+        fs::resize_file(path, m_Checkpoint["files"][WcharToText(name)]
+            .get<uintmax_t>());
+    }
+    else if (fs::exists(path))
+    {
+        fs::remove(path);
+    }
+
+    CroSync* out = CreateSyncFile(path, bufferSize, codec, m_CompressLevel,
+        m_bExportDirect);
+    m_Outputs[name] = out;
+    return out;
+}
+
+void CentaurusExport::SetOutput(ICroExport* exp, CroIdent ident,
+    const std::wstring& name, cronos_size bufferSize, crocodec_type codec)
+{
+    CroSync* out = OpenOutput(name, bufferSize, codec);
+    if (IsResumed(name))
+        exp->ResumeIdentOutput(ident, out);
+    else
+        exp->SetIdentOutput(ident, out);
+}
+
+void CentaurusExport::DiffMap(CroRecordMap* map,
+    std::vector<cronos_id>& inserts, std::vector<cronos_id>& updates)
+{
+    for (cronos_id id = map->IdStart(); id != map->IdEnd(); id++)
+    {
+        if (!map->HasRecord(id))
+        {
+            if (m_PrevIndex.HasEntry(id)) WriteDelete(id);
+            continue;
+        }
+
+        CroEntry entry = map->GetEntry(id);
+        crodelta_change change = m_PrevIndex.Compare(id, entry);
+        crodelta_entry& delta = m_Index.SetEntry(id, entry);
+
+        if (change == CroDelta_None)
+        {
+            const crodelta_entry& prev = m_PrevIndex.GetEntry(id);
+            delta.m_Base = prev.m_Base;
+            delta.m_Hash = prev.m_Hash;
+
+            // records rewritten in place keep their TAD entry
+            if (m_bDeltaHash)
+            {
+                try {
+                    CroBuffer raw = map->ReadRecord(id);
+                    delta.m_Hash = CroDeltaHash(raw.GetData(),
+                        raw.GetSize());
+                }
+                catch (const std::exception&) {
+                    delta.m_Hash = 0;
+                }
+
+                if (m_PrevIndex.HasHash() && delta.m_Hash != prev.m_Hash)
+                    change = CroDelta_Update;
+            }
+        }
+
+        if (change == CroDelta_Insert) inserts.push_back(id);
+        else if (change == CroDelta_Update) updates.push_back(id);
+    }
+}
+
+void CentaurusExport::WriteDelete(cronos_id id)
+{
+    auto out = m_DeleteOutputs.find(m_PrevIndex.GetEntry(id).m_Base);
+    if (out == m_DeleteOutputs.end()) return;
+
+    std::string line = std::to_string(id) + "\r\n";
+    out->second->Write((const uint8_t*)line.data(), line.size());
+}
+
 void CentaurusExport::Export()
 {
     if (!m_Export)
@@ -239,11 +644,40 @@ void CentaurusExport::Export()
     }
 
     cronos_size defSize = file->GetDefaultBlockSize();
-    CroReader* reader = m_Export->GetReader();
+    // the insert and update pools of a delta run share the job's threads
+    unsigned threads = PoolThreads();
+    if (m_bDeltaRun) threads = std::max(threads / 2, 1u);
+
+    CroExportParallel parallel(m_Export.get(), m_pBank, threads);
+    std::unique_ptr<CroExportParallel> update;
+    if (m_bDeltaRun)
+    {
+        update = std::make_unique<CroExportParallel>(
+            m_UpdateExport.get(), m_pBank, threads);
+    }
+
+    auto onRecord = [this](const croparallel_record& record) {
+        m_Index.SetBase(record.m_Id, record.m_Base, record.m_Hash);
+    };
+    parallel.SetRecordCallback(onRecord, m_bDeltaHash);
+    if (update) update->SetRecordCallback(onRecord, m_bDeltaHash);
+
+    // mid window the map and slices are held, urgent work and pauses
+    // wait for the window boundary below
+    auto onCheck = [this]() { CheckCancel(); };
+    parallel.SetCheckCallback(onCheck);
+    if (update) update->SetCheckCallback(onCheck);
 
     cronos_id map_id = 1;
+    if (m_Checkpoint.is_object())
+        map_id = m_Checkpoint["map_id"].get<cronos_id>();
+
+    time_t lastCheckpoint = time(NULL);
     cronos_idx burst = m_BlockLimit / defSize;
     do {
+        // window boundary, nothing of the previous window is held
+        CheckTask();
+
         burst = std::min((cronos_id)(m_BlockLimit / defSize),
             file->EntryCountFileSize());
         auto bank = GetRecordMap(map_id, burst);
@@ -254,18 +688,65 @@ void CentaurusExport::Export()
         }
 
         try {
-            m_Export->Export(bank);
+            if (m_bDeltaRun)
+            {
+                std::vector<cronos_id> inserts, updates;
+                DiffMap(bank, inserts, updates);
+
+                parallel.Export(bank, &inserts);
+                update->Export(bank, &updates);
+            }
+            else
+            {
+                for (cronos_id id = bank->IdStart(); id != bank->IdEnd(); id++)
+                    if (bank->HasRecord(id))
+                        m_Index.SetEntry(id, bank->GetEntry(id));
+
+                parallel.Export(bank);
+            }
 
             map_id = bank->IdEnd();
         }
+        catch (const CentaurusCancelled&) {
+            ReleaseMap();
+            throw;
+        }
         catch (const std::exception& e) {
             Error("export exception: %s\n", e.what());
+
+            // rows of the window may be written already, reading it
+            // again would repeat them: drop the rest and move past it
+            parallel.Reset();
+            if (update) update->Reset();
+            map_id = bank->IdEnd();
         }
 
         ReleaseMap();
         FlushBuffers();
+
+        if (m_Export->IsResumable()
+            && time(NULL) - lastCheckpoint >= CENTAURUS_CHECKPOINT_INTERVAL)
+        {
+            parallel.Finish();
+            if (update) update->Finish();
+
+            Checkpoint(map_id);
+            lastCheckpoint = time(NULL);
+        }
     } while (map_id < file->IdEntryEnd());
 
+    if (m_bDeltaRun)
+    {
+        // records beyond the end of the current TAD
+        for (cronos_id id = map_id; id < m_PrevIndex.IdEnd(); id++)
+            if (m_PrevIndex.HasEntry(id)) WriteDelete(id);
+
+        update->Finish();
+        m_UpdateExport->ExportFinish();
+    }
+
+    parallel.Finish();
+    m_Export->ExportFinish();
     FlushBuffers();
     centaurus->UpdateBankExportIndex(
         m_pBank->BankId(), m_ExportPath);
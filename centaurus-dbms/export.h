@@ -4,11 +4,25 @@
 #include <centaurus_api.h>
 
 #include <croexport.h>
+#include <crocodec.h>
+#include <crodelta.h>
+#include <croblob.h>
 #include <json_file.h>
 #include <memory>
+#include <map>
 
 #include "cronos_api.h"
 
+#define CENTAURUS_DELTA_INSERT  L"insert"
+#define CENTAURUS_DELTA_UPDATE  L"update"
+#define CENTAURUS_DELTA_DELETE  L"delete"
+
+#define CENTAURUS_CHECKPOINT_FILE       L"export.checkpoint"
+#define CENTAURUS_CHECKPOINT_INDEX      L"export.checkpoint.index"
+#define CENTAURUS_CHECKPOINT_INTERVAL   60
+
+#define CENTAURUS_BLOB_DIR      L"blobs"
+
 class CentaurusExport : public CronosAPI, public ICentaurusExport
 {
 public:
@@ -18,6 +32,12 @@ public:
     const std::wstring& ExportPath() const override;
     ExportFormat GetExportFormat() const override;
     void SetExportFormat(ExportFormat fmt) override;
+    ExportCompression GetExportCompression() const override;
+    void SetExportCompression(ExportCompression comp, int level) override;
+    bool IsExportDelta() const override;
+    void SetExportDelta(bool delta, bool hash) override;
+    bool IsExportDirect() const override;
+    void SetExportDirect(bool direct) override;
     void SyncBankJson() override;
 
     void PrepareDirs();
@@ -27,13 +47,44 @@ public:
 
     void Export();
 private:
+    ICroExport* CreateExport(crocodec_type codec,
+        const std::wstring& sqliteName);
+    void DiffMap(CroRecordMap* map, std::vector<cronos_id>& inserts,
+        std::vector<cronos_id>& updates);
+    void WriteDelete(cronos_id id);
+
+    bool LoadCheckpoint();
+    void Checkpoint(cronos_id map_id);
+    bool IsResumed(const std::wstring& name) const;
+    CroSync* OpenOutput(const std::wstring& name, cronos_size bufferSize,
+        crocodec_type codec);
+    void SetOutput(ICroExport* exp, CroIdent ident, const std::wstring& name,
+        cronos_size bufferSize, crocodec_type codec);
+
     ExportFormat m_ExportFormat;
+    ExportCompression m_ExportCompression;
+    int m_CompressLevel;
 
     std::wstring m_ExportPath;
+    std::wstring m_OutputPath;
     std::wstring m_FilePath;
 
     nlohmann::json m_BankJson;
     std::unique_ptr<ICroExport> m_Export;
+
+    bool m_bExportDelta;
+    bool m_bDeltaHash;
+    bool m_bDeltaRun;
+    bool m_bExportDirect;
+    CroDeltaIndex m_PrevIndex;
+    CroDeltaIndex m_Index;
+    std::unique_ptr<ICroExport> m_UpdateExport;
+    std::map<CroIdent, CroSync*> m_DeleteOutputs;
+
+    nlohmann::json m_Checkpoint;
+    std::map<std::wstring, CroSync*> m_Outputs;
+
+    std::unique_ptr<CroBlobStore> m_pBlobStore;
 };
 
 #endif
\ No newline at end of file
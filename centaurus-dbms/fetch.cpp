@@ -3,54 +3,126 @@
 #include "cronos_api.h"
 #include <win32util.h>
 
-CentaurusFetch::CentaurusFetch()
+/* CentaurusFetchQueue */
+
+CentaurusFetchQueue::CentaurusFetchQueue()
 {
-    m_LoadedPath = L"";
-    m_pLoadedBank = NULL;
+    m_Pending = 0;
 }
 
-void CentaurusFetch::RequestBank(const std::wstring& path)
+void CentaurusFetchQueue::RequestBank(const std::wstring& path,
+    CentaurusBankCallback callback)
 {
     {
-        auto lock = scoped_lock(m_DataLock);
-        m_Dirs.push(path);
+        auto lock = scoped_lock(m_Lock);
+        m_Requests.push_front({ path, false, callback });
+        m_Pending++;
     }
-    m_SyncCond.notify_one();
+    m_Cond.notify_one();
 }
 
-void CentaurusFetch::RequestBanks(std::vector<std::wstring> dirs)
+void CentaurusFetchQueue::RequestBanks(std::vector<std::wstring> dirs)
 {
     {
-        auto lock = scoped_lock(m_DataLock);
-        for (const auto& dir : dirs) m_Dirs.push(dir);
+        auto lock = scoped_lock(m_Lock);
+        for (const auto& dir : dirs)
+            m_Requests.push_back({ dir, false, nullptr });
+        m_Pending += dirs.size();
     }
-    m_SyncCond.notify_one();
+    m_Cond.notify_all();
 }
 
-void CentaurusFetch::Execute()
+void CentaurusFetchQueue::RequestAll(const std::wstring& path,
+    CentaurusBankCallback callback)
 {
-    if (m_Dirs.empty())
     {
-        m_State = Waiting;
-        return;
+        auto lock = scoped_lock(m_Lock);
+        m_Requests.push_back({ path, true, callback });
+        m_Pending++;
     }
+    m_Cond.notify_one();
+}
+
+centaurus_fetch_request CentaurusFetchQueue::Take()
+{
+    boost::unique_lock<boost::mutex> lock(m_Lock);
+    while (m_Requests.empty())
+        m_Cond.wait(lock);
+
+    centaurus_fetch_request request = std::move(m_Requests.front());
+    m_Requests.pop_front();
+    return request;
+}
 
-    std::wstring dir;
+void CentaurusFetchQueue::Done()
+{
+    auto lock = scoped_lock(m_Lock);
+    if (m_Pending && !--m_Pending)
+        m_IdleCond.notify_all();
+}
+
+void CentaurusFetchQueue::Wait()
+{
+    boost::unique_lock<boost::mutex> lock(m_Lock);
+    while (m_Pending)
+        m_IdleCond.wait(lock);
+}
+
+/* CentaurusFetch */
+
+CentaurusFetch::CentaurusFetch(CentaurusFetchQueue* queue)
+{
+    m_pQueue = queue;
+    m_LoadedPath = L"";
+    m_pLoadedBank = NULL;
+}
+
+void CentaurusFetch::Execute()
+{
+    centaurus_fetch_request request = m_pQueue->Take();
+    if (request.m_bScan)
     {
-        auto lock = scoped_lock(m_DataLock);
-        dir = m_Dirs.front();
-        m_Dirs.pop();
+        ScanPath(request.m_Path, request.m_Callback);
+        m_pQueue->Done();
+        return;
     }
 
-    m_LoadedPath = dir;
-    if (!LoadPath(dir))
+    // completed by CentaurusAPI::Sync once the bank is registered
+    m_LoadedPath = request.m_Path;
+    m_LoadedCallback = std::move(request.m_Callback);
+    if (!LoadPath(request.m_Path))
     {
-        Error("failed to load %s\n", WcharToAnsi(dir).c_str());
+        Error("failed to load %s\n", WcharToAnsi(request.m_Path).c_str());
 
         m_pLoadedBank = NULL;
     }
 }
 
+void CentaurusFetch::ScanPath(const std::wstring& path,
+    const CentaurusBankCallback& callback)
+{
+    try {
+        auto [files, dirs] = ListDirectory(path);
+        for (auto& file : files)
+        {
+            if (file == CENTAURUS_FETCH_BANK_FILE)
+            {
+                m_pQueue->RequestBank(path, callback);
+                break;
+            }
+        }
+
+        for (auto& dir : dirs)
+        {
+            if (dir != CENTAURUS_FETCH_SKIP_DIR)
+                m_pQueue->RequestAll(JoinFilePath(path, dir), callback);
+        }
+    }
+    catch (const std::exception& e) {
+        Error("failed to scan %s: %s\n", WcharToAnsi(path).c_str(), e.what());
+    }
+}
+
 bool CentaurusFetch::LoadPath(const std::wstring& path)
 {
     auto cro = std::make_unique<CronosAPI>("CentaurusFetch");
@@ -59,7 +131,8 @@ bool CentaurusFetch::LoadPath(const std::wstring& path)
 
     try {
         bank->SetBankPath(path);
-        cro->LoadBank(bank);
+        // loading rebuilds the structure, nobody else may read it yet
+        cro->LoadBank(bank, LeaseExclusive);
 
         bank->Load(cro.get());
         m_pLoadedBank = bank;
@@ -67,10 +140,10 @@ bool CentaurusFetch::LoadPath(const std::wstring& path)
     catch (const std::exception& e) {
         Error("%s", e.what());
 
+        cro = nullptr;
         delete bank;
         m_pLoadedBank = NULL;
     }
 
     return m_pLoadedBank != NULL;
-}
-
+}
\ No newline at end of file
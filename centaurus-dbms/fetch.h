@@ -3,25 +3,59 @@
 
 #include "worker.h"
 #include <string>
-#include <queue>
+#include <deque>
 
-class CentaurusFetch : public CentaurusWorker
+#include <boost/thread/condition_variable.hpp>
+
+#define CENTAURUS_FETCH_BANK_FILE L"CroBank.dat"
+#define CENTAURUS_FETCH_SKIP_DIR L"Voc"
+
+struct centaurus_fetch_request {
+    std::wstring m_Path;
+    bool m_bScan;
+    CentaurusBankCallback m_Callback;
+};
+
+// Shared by all fetch workers. Bank loads are taken before directory
+// scans, so structures are loaded while the walk is still running.
+class CentaurusFetchQueue
 {
 public:
-    CentaurusFetch();
+    CentaurusFetchQueue();
 
-    void RequestBank(const std::wstring& path);
+    void RequestBank(const std::wstring& path,
+        CentaurusBankCallback callback = nullptr);
     void RequestBanks(std::vector<std::wstring> dirs);
-    void RequestAll(const std::wstring& path);
+    void RequestAll(const std::wstring& path, CentaurusBankCallback callback);
+
+    centaurus_fetch_request Take();
+    void Done();
+    void Wait();
+private:
+    boost::mutex m_Lock;
+    boost::condition_variable m_Cond;
+    boost::condition_variable m_IdleCond;
+
+    std::deque<centaurus_fetch_request> m_Requests;
+    unsigned m_Pending;
+};
+
+class CentaurusFetch : public CentaurusWorker
+{
+public:
+    CentaurusFetch(CentaurusFetchQueue* queue);
 protected:
     void Execute() override;
 
+    void ScanPath(const std::wstring& path,
+        const CentaurusBankCallback& callback);
     bool LoadPath(const std::wstring& path);
 private:
-    std::queue<std::wstring> m_Dirs;
+    CentaurusFetchQueue* m_pQueue;
 public:
     std::wstring m_LoadedPath;
     ICentaurusBank* m_pLoadedBank;
+    CentaurusBankCallback m_LoadedCallback;
 };
 
 #endif
\ No newline at end of file
@@ -11,8 +11,21 @@ public:
     void RunTask() override {}
     void Release() override {}
     centaurus_size GetMemoryUsage() override { return 0; }
+    centaurus_size EstimateMemory() override { return 0; }
+    TaskPriority GetTaskPriority() const override
+    {
+        return PriorityInteractive;
+    }
+    ICentaurusBank* TaskBank() override { return NULL; }
 
-    bool AcquireBank(ICentaurusBank* bank) override { return false; }
+    void CancelTask() override {}
+    void PauseTask() override {}
+    void ContinueTask() override {}
+    bool IsTaskCancelled() const override { return false; }
+    void SetTaskDeadline(
+        std::chrono::steady_clock::time_point deadline) override {}
+
+    bool AcquireBank(ICentaurusBank* bank, BankLease lease) override { return false; }
     CroTable* AcquireTable(CroTable&& table) override { return NULL; }
     bool IsBankAcquired(ICentaurusBank* bank) override { return false; }
     void ReleaseTable(CroTable* table) override {}
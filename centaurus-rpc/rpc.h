@@ -23,7 +23,8 @@ public:
     virtual void Release() = 0;
     virtual centaurus_size GetMemoryUsage() = 0;
 
-    virtual bool AcquireBank(ICentaurusBank* bank) = 0;
+    virtual bool AcquireBank(ICentaurusBank* bank,
+        BankLease lease = LeaseShared) = 0;
     virtual CroTable* AcquireTable(CroTable&& table) = 0;
     virtual bool IsBankAcquired(ICentaurusBank* bank) = 0;
     virtual void ReleaseTable(CroTable* table) = 0;
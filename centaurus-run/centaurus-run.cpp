@@ -11,6 +11,13 @@ std::wstring rootPath;
 std::wstring bankPath;
 centaurus_size tableLimit = 512; //512 MB
 unsigned workerLimit = 4;
+unsigned fetchLimit = 4;
+ExportFormat exportFormat = ExportCSV;
+ExportCompression exportCompression = CompressNone;
+int compressLevel = -1;
+bool exportDelta = false;
+bool deltaHash = false;
+bool exportDirect = false;
 
 void FixHeader(const std::wstring& datPath)
 {
@@ -25,60 +32,46 @@ void FixHeader(const std::wstring& datPath)
 
 static ICentaurusLogger* findLog;
 
-void FindBanks(const std::wstring& path)
+void OnBank(const std::wstring& path, ICentaurusBank* bank)
 {
-    findLog->Log("%s\n", WcharToTerm(path).c_str());
-    
-    auto [files, dirs] = ListDirectory(path);
-    for (auto& file : files)
+    if (!bank || !centaurus->IsBankLoaded(bank))
     {
-        if (file == L"CroBank.dat")
-        {
-            centaurus->ConnectBank(path);
-            ICentaurusBank* bank = centaurus->WaitBank(path);
-            if (!centaurus->IsBankLoaded(bank))
-            {
-                findLog->Error("Failed to connect %s\n",
-                    WcharToTerm(path).c_str());
-                break;
-            }
+        findLog->Error("Failed to connect %s\n",
+            WcharToTerm(path).c_str());
+        return;
+    }
 
-            std::string name = WcharToTerm(bank->BankName());
-            findLog->Log("\"%s\", ID %d\n", name.c_str(), bank->BankId());
+    std::string name = WcharToTerm(bank->BankName());
+    findLog->Log("%s \"%s\", ID %d\n", WcharToTerm(path).c_str(),
+        name.c_str(), bank->BankId());
 
-            if (testMode)
-            {
-                findLog->Log("TEST \"%s\"\n", WcharToTerm(path).c_str());
-            }
-            else if (exportMode)
-            {
-#ifdef CENTAURUS_RELEASE
-                ICentaurusTask* exportTask = CentaurusTask_Export(bank);
-                centaurus->StartTask(exportTask);
-                if (centaurus->IsBankExported(bank->BankId()))
-                {
-                    findLog->Log("\"%s\" already exported\n", name.c_str());
-                }
-                else
-                {
-                    ICentaurusTask* exportTask = CentaurusTask_Export(bank);
-                    centaurus->StartTask(exportTask);
-                }
-#else
-                ICentaurusTask* exportTask = CentaurusDBMS_TaskExport(bank);
-                centaurus->StartTask(exportTask);
-#endif
-            }
-            break;
-        }
+    if (testMode)
+    {
+        findLog->Log("TEST \"%s\"\n", WcharToTerm(path).c_str());
     }
-
-    for (auto& dir : dirs)
+    else if (exportMode)
     {
-        if (dir != L"Voc")
+#ifdef CENTAURUS_RELEASE
+        if (centaurus->IsBankExported(bank->BankId()))
         {
-            FindBanks(JoinFilePath(path, dir));
+            findLog->Log("\"%s\" already exported\n", name.c_str());
         }
+        else
+        {
+            ICentaurusTask* exportTask = CentaurusTask_Export(bank);
+            centaurus->StartTask(exportTask);
+        }
+#else
+        ICentaurusTask* exportTask = CentaurusDBMS_TaskExport(bank,
+            exportFormat, exportCompression, compressLevel);
+        auto exp = dynamic_cast<ICentaurusExport*>(exportTask);
+        if (exp)
+        {
+            exp->SetExportDelta(exportDelta, deltaHash);
+            exp->SetExportDirect(exportDirect);
+        }
+        centaurus->StartTask(exportTask);
+#endif
     }
 }
 
@@ -108,6 +101,34 @@ int main(int argc, char** argv)
             tableLimit = atoi(argv[++i]);
         else if (option == "--workers")
             workerLimit = atoi(argv[++i]);
+        else if (option == "--fetch")
+            fetchLimit = atoi(argv[++i]);
+        else if (option == "--format")
+        {
+            std::string format = argv[++i];
+            if (format == "csv") exportFormat = ExportCSV;
+            else if (format == "json") exportFormat = ExportJSON;
+            else if (format == "arrow") exportFormat = ExportArrow;
+            else if (format == "parquet") exportFormat = ExportParquet;
+            else if (format == "raw") exportFormat = ExportRaw;
+            else if (format == "postgres") exportFormat = ExportPostgres;
+            else if (format == "sqlite") exportFormat = ExportSQLite;
+        }
+        else if (option == "--compress")
+        {
+            std::string compress = argv[++i];
+            if (compress == "none") exportCompression = CompressNone;
+            else if (compress == "gzip") exportCompression = CompressGzip;
+            else if (compress == "zstd") exportCompression = CompressZstd;
+        }
+        else if (option == "--level")
+            compressLevel = atoi(argv[++i]);
+        else if (option == "--delta")
+            exportDelta = true;
+        else if (option == "--delta-hash")
+            exportDelta = deltaHash = true;
+        else if (option == "--direct")
+            exportDirect = true;
     }
 
     if (!Centaurus_Init(rootPath))
@@ -118,9 +139,10 @@ int main(int argc, char** argv)
 
     centaurus->SetMemoryLimit(tableLimit * 1024 * 1024);
     centaurus->SetWorkerLimit(workerLimit);
+    centaurus->SetFetchLimit(fetchLimit ? fetchLimit : 1);
 
     findLog = CentaurusLogger_Forward("FindBanks");
-    FindBanks(bankPath);
+    centaurus->FindBanks(bankPath, OnBank);
 
     CentaurusAPI_RunThread();
     CentaurusAPI_Idle();
@@ -0,0 +1,474 @@
+#include "croarrow.h"
+#include <string.h>
+#include <algorithm>
+
+#define CROARROW_METADATA_V5    4
+
+#define CROARROW_HEADER_SCHEMA  1
+#define CROARROW_HEADER_BATCH   3
+
+#define CROARROW_TYPE_INT       2
+#define CROARROW_TYPE_UTF8      5
+#define CROARROW_TYPE_DATE      8
+#define CROARROW_TYPE_TIME      9
+
+#define CROARROW_DATE_DAY       0
+#define CROARROW_TIME_MS        1
+
+/* CroFlatTable */
+
+static void FlatPad(std::vector<uint8_t>& buf, size_t align, size_t mod = 0)
+{
+    while (buf.size() % align != mod)
+        buf.push_back(0);
+}
+
+template<typename T>
+static void FlatPut(std::vector<uint8_t>& buf, T value)
+{
+    const uint8_t* data = (const uint8_t*)&value;
+    buf.insert(buf.end(), data, data + sizeof(T));
+}
+
+template<typename T>
+static void FlatPatch(std::vector<uint8_t>& buf, size_t pos, T value)
+{
+    memcpy(buf.data() + pos, &value, sizeof(T));
+}
+
+// Minimal flatbuffers builder for the Arrow metadata. Tables are laid out
+// front to back: vtable, table, then children, so every uoffset points
+// forward as the format requires.
+class CroFlatTable
+{
+public:
+    template<typename T> inline void Add(unsigned id, T value)
+    {
+        flat_field& field = AddField(id, sizeof(T), Flat_Scalar);
+        memcpy(field.m_Scalar, &value, sizeof(T));
+    }
+
+    void AddString(unsigned id, const std::string& str)
+    {
+        AddField(id, 4, Flat_String).m_Data = str;
+    }
+
+    void AddTable(unsigned id, const CroFlatTable& table)
+    {
+        AddField(id, 4, Flat_Table).m_Tables.push_back(table);
+    }
+
+    void AddTables(unsigned id, const std::vector<CroFlatTable>& tables)
+    {
+        AddField(id, 4, Flat_Tables).m_Tables = tables;
+    }
+
+    void AddStructs(unsigned id, const void* data,
+        unsigned count, unsigned size)
+    {
+        flat_field& field = AddField(id, 4, Flat_Structs);
+        field.m_Data.assign((const char*)data, (size_t)count * size);
+        field.m_Count = count;
+    }
+
+    std::vector<uint8_t> Finish() const
+    {
+        std::vector<uint8_t> buf;
+
+        FlatPut<uint32_t>(buf, 0);
+        FlatPatch<uint32_t>(buf, 0, (uint32_t)Write(buf));
+        FlatPad(buf, CROARROW_ALIGN);
+        return buf;
+    }
+private:
+    enum flat_kind {
+        Flat_Scalar,
+        Flat_String,
+        Flat_Table,
+        Flat_Tables,
+        Flat_Structs
+    };
+
+    struct flat_field {
+        unsigned m_Id;
+        unsigned m_Size;
+        flat_kind m_Kind;
+
+        uint8_t m_Scalar[8];
+        std::string m_Data;
+        unsigned m_Count;
+        std::vector<CroFlatTable> m_Tables;
+    };
+
+    flat_field& AddField(unsigned id, unsigned size, flat_kind kind)
+    {
+        flat_field& field = m_Fields.emplace_back();
+        field.m_Id = id;
+        field.m_Size = size;
+        field.m_Kind = kind;
+        field.m_Count = 0;
+        return field;
+    }
+
+    size_t Write(std::vector<uint8_t>& buf) const
+    {
+        unsigned fieldCount = 0;
+        bool wide = false;
+
+        std::vector<const flat_field*> order;
+        for (const auto& field : m_Fields)
+        {
+            fieldCount = std::max(fieldCount, field.m_Id + 1);
+            wide |= field.m_Size == 8;
+            order.push_back(&field);
+        }
+
+        // widest first, so 8-byte scalars stay aligned after the soffset
+        std::stable_sort(order.begin(), order.end(),
+            [](const flat_field* a, const flat_field* b) -> bool
+            {
+                return a->m_Size > b->m_Size;
+            }
+        );
+
+        FlatPad(buf, 2);
+        size_t vtable = buf.size();
+        FlatPut<uint16_t>(buf, (uint16_t)(4 + 2 * fieldCount));
+        FlatPut<uint16_t>(buf, 0);
+        for (unsigned i = 0; i < fieldCount; i++)
+            FlatPut<uint16_t>(buf, 0);
+
+        if (wide) FlatPad(buf, 8, 4);
+        else FlatPad(buf, 4);
+
+        size_t table = buf.size();
+        FlatPut<int32_t>(buf, (int32_t)(table - vtable));
+
+        std::vector<std::pair<const flat_field*, size_t>> children;
+        for (const flat_field* field : order)
+        {
+            size_t pos = buf.size();
+            FlatPatch<uint16_t>(buf, vtable + 4 + 2 * field->m_Id,
+                (uint16_t)(pos - table));
+
+            if (field->m_Kind == Flat_Scalar)
+            {
+                buf.insert(buf.end(), field->m_Scalar,
+                    field->m_Scalar + field->m_Size);
+            }
+            else
+            {
+                FlatPut<uint32_t>(buf, 0);
+                children.emplace_back(field, pos);
+            }
+        }
+        FlatPatch<uint16_t>(buf, vtable + 2, (uint16_t)(buf.size() - table));
+
+        for (auto& [field, pos] : children)
+        {
+            size_t child = WriteChild(buf, *field);
+            FlatPatch<uint32_t>(buf, pos, (uint32_t)(child - pos));
+        }
+
+        return table;
+    }
+
+    static size_t WriteChild(std::vector<uint8_t>& buf,
+        const flat_field& field)
+    {
+        size_t pos;
+        switch (field.m_Kind)
+        {
+        case Flat_String:
+            FlatPad(buf, 4);
+            pos = buf.size();
+            FlatPut<uint32_t>(buf, (uint32_t)field.m_Data.size());
+            buf.insert(buf.end(), field.m_Data.begin(), field.m_Data.end());
+            buf.push_back(0);
+            return pos;
+        case Flat_Table:
+            return field.m_Tables.front().Write(buf);
+        case Flat_Tables:
+            FlatPad(buf, 4);
+            pos = buf.size();
+            FlatPut<uint32_t>(buf, (uint32_t)field.m_Tables.size());
+            for (unsigned i = 0; i < field.m_Tables.size(); i++)
+                FlatPut<uint32_t>(buf, 0);
+
+            for (unsigned i = 0; i < field.m_Tables.size(); i++)
+            {
+                size_t elem = pos + 4 + 4 * i;
+                size_t child = field.m_Tables[i].Write(buf);
+                FlatPatch<uint32_t>(buf, elem, (uint32_t)(child - elem));
+            }
+            return pos;
+        case Flat_Structs:
+            FlatPad(buf, 8, 4);
+            pos = buf.size();
+            FlatPut<uint32_t>(buf, field.m_Count);
+            buf.insert(buf.end(), field.m_Data.begin(), field.m_Data.end());
+            return pos;
+        default:
+            return buf.size();
+        }
+    }
+
+    std::vector<flat_field> m_Fields;
+};
+
+static CroFlatTable ArrowField(const std::string& name, crocolumn_type type)
+{
+    CroFlatTable field, fieldType;
+    uint8_t typeId = CROARROW_TYPE_UTF8;
+
+    switch (type)
+    {
+    case CroColumn_Integer:
+        typeId = CROARROW_TYPE_INT;
+        fieldType.Add<int32_t>(0, 64);
+        fieldType.Add<uint8_t>(1, 1);
+        break;
+    case CroColumn_Date:
+        typeId = CROARROW_TYPE_DATE;
+        fieldType.Add<int16_t>(0, CROARROW_DATE_DAY);
+        break;
+    case CroColumn_Time:
+        typeId = CROARROW_TYPE_TIME;
+        fieldType.Add<int16_t>(0, CROARROW_TIME_MS);
+        fieldType.Add<int32_t>(1, 32);
+        break;
+    case CroColumn_Text:
+        break;
+    }
+
+    field.AddString(0, name);
+    field.Add<uint8_t>(1, 1);
+    field.Add<uint8_t>(2, typeId);
+    field.AddTable(3, fieldType);
+    field.AddTables(5, {});
+    return field;
+}
+
+static CroFlatTable ArrowSchema(
+    const std::vector<std::pair<std::string, crocolumn_type>>& schema)
+{
+    CroFlatTable table;
+    std::vector<CroFlatTable> fields;
+
+    for (const auto& [name, type] : schema)
+        fields.push_back(ArrowField(name, type));
+
+    table.Add<int16_t>(0, 0);
+    table.AddTables(1, fields);
+    return table;
+}
+
+static std::vector<uint8_t> ArrowMessage(uint8_t headerType,
+    const CroFlatTable& header, int64_t bodyLength)
+{
+    CroFlatTable message;
+
+    message.Add<int16_t>(0, CROARROW_METADATA_V5);
+    message.Add<uint8_t>(1, headerType);
+    message.AddTable(2, header);
+    message.Add<int64_t>(3, bodyLength);
+    return message.Finish();
+}
+
+static inline cronos_size ArrowPadded(cronos_size size)
+{
+    return (size + CROARROW_ALIGN - 1) & ~(cronos_size)(CROARROW_ALIGN - 1);
+}
+
+/* CroArrowWriter */
+
+CroArrowWriter::CroArrowWriter(const CroColumnBatch& schema, CroSync* out)
+    : m_pOut(out), m_Offset(0), m_bSchema(false), m_bClosed(false)
+{
+    for (unsigned i = 0; i < schema.ColumnCount(); i++)
+    {
+        const CroColumn& column = schema.Column(i);
+        m_Schema.emplace_back(column.ColumnName(), column.ColumnType());
+    }
+}
+
+void CroArrowWriter::WriteData(const void* data, cronos_size size)
+{
+    if (!size) return;
+
+    m_pOut->Write((const uint8_t*)data, size);
+    m_Offset += size;
+}
+
+void CroArrowWriter::WritePadding(cronos_size size)
+{
+    static const uint8_t zero[CROARROW_ALIGN] = { 0 };
+    WriteData(zero, ArrowPadded(size) - size);
+}
+
+int32_t CroArrowWriter::WriteMessage(const std::vector<uint8_t>& meta)
+{
+    uint32_t marker = CROARROW_CONTINUATION;
+    int32_t metaSize = (int32_t)meta.size();
+
+    WriteData(&marker, sizeof(marker));
+    WriteData(&metaSize, sizeof(metaSize));
+    WriteData(meta.data(), meta.size());
+
+    return metaSize + 8;
+}
+
+void CroArrowWriter::WriteSchema()
+{
+    if (m_bSchema) return;
+
+    static const uint8_t magic[CROARROW_ALIGN] = CROARROW_MAGIC;
+    WriteData(magic, sizeof(magic));
+
+    WriteMessage(ArrowMessage(CROARROW_HEADER_SCHEMA,
+        ArrowSchema(m_Schema), 0));
+    m_bSchema = true;
+}
+
+void CroArrowWriter::WriteBatch(const CroColumnBatch& batch)
+{
+    struct arrow_node { int64_t m_Length; int64_t m_NullCount; };
+    struct arrow_buffer { int64_t m_Offset; int64_t m_Length; };
+
+    WriteSchema();
+
+    int64_t rows = batch.RowCount();
+    std::vector<arrow_node> nodes;
+    std::vector<arrow_buffer> buffers;
+    int64_t body = 0;
+
+    auto addBuffer = [&](cronos_size size) {
+        buffers.push_back({ body, (int64_t)size });
+        body += ArrowPadded(size);
+    };
+
+    for (unsigned i = 0; i < batch.ColumnCount(); i++)
+    {
+        const CroColumn& column = batch.Column(i);
+        nodes.push_back({ rows, column.NullCount() });
+
+        addBuffer(column.NullCount() ? (rows + 7) / 8 : 0);
+        switch (column.ColumnType())
+        {
+        case CroColumn_Integer:
+            addBuffer(rows * sizeof(int64_t));
+            break;
+        case CroColumn_Date:
+        case CroColumn_Time:
+            addBuffer(rows * sizeof(int32_t));
+            break;
+        case CroColumn_Text:
+            addBuffer((rows + 1) * sizeof(int32_t));
+            addBuffer(column.m_Text.size());
+            break;
+        }
+    }
+
+    CroFlatTable header;
+    header.Add<int64_t>(0, rows);
+    header.AddStructs(1, nodes.data(), nodes.size(), sizeof(arrow_node));
+    header.AddStructs(2, buffers.data(), buffers.size(),
+        sizeof(arrow_buffer));
+
+    croarrow_block block = { (int64_t)m_Offset, 0, 0, body };
+    block.m_MetaLength = WriteMessage(ArrowMessage(
+        CROARROW_HEADER_BATCH, header, body));
+
+    std::vector<uint8_t> bitmap;
+    std::vector<int32_t> narrow;
+    for (unsigned i = 0; i < batch.ColumnCount(); i++)
+    {
+        const CroColumn& column = batch.Column(i);
+        if (column.NullCount())
+        {
+            bitmap.assign((rows + 7) / 8, 0);
+            for (cronos_idx row = 0; row < rows; row++)
+            {
+                if (!column.IsNull(row))
+                    bitmap[row / 8] |= 1 << (row % 8);
+            }
+
+            WriteData(bitmap.data(), bitmap.size());
+            WritePadding(bitmap.size());
+        }
+
+        switch (column.ColumnType())
+        {
+        case CroColumn_Integer:
+            WriteData(column.m_Integer.data(), rows * sizeof(int64_t));
+            break;
+        case CroColumn_Date:
+        case CroColumn_Time:
+            narrow.assign(column.m_Integer.begin(), column.m_Integer.end());
+            WriteData(narrow.data(), rows * sizeof(int32_t));
+            WritePadding(rows * sizeof(int32_t));
+            break;
+        case CroColumn_Text:
+            WriteData(column.m_Offsets.data(), (rows + 1) * sizeof(int32_t));
+            WritePadding((rows + 1) * sizeof(int32_t));
+            WriteData(column.m_Text.data(), column.m_Text.size());
+            WritePadding(column.m_Text.size());
+            break;
+        }
+    }
+
+    m_Blocks.push_back(block);
+}
+
+void CroArrowWriter::Close()
+{
+    if (m_bClosed) return;
+    WriteSchema();
+
+    uint32_t eos[2] = { CROARROW_CONTINUATION, 0 };
+    WriteData(eos, sizeof(eos));
+
+    CroFlatTable footer;
+    footer.Add<int16_t>(0, CROARROW_METADATA_V5);
+    footer.AddTable(1, ArrowSchema(m_Schema));
+    footer.AddStructs(2, NULL, 0, sizeof(croarrow_block));
+    footer.AddStructs(3, m_Blocks.data(), m_Blocks.size(),
+        sizeof(croarrow_block));
+
+    std::vector<uint8_t> meta = footer.Finish();
+    int32_t metaSize = (int32_t)meta.size();
+
+    WriteData(meta.data(), meta.size());
+    WriteData(&metaSize, sizeof(metaSize));
+    WriteData(CROARROW_MAGIC, strlen(CROARROW_MAGIC));
+
+    m_bClosed = true;
+}
+
+/* CroExportArrow */
+
+CroExportArrow::CroExportArrow(CroBank* bank)
+    : CroExportColumns<CroExportFormat::Arrow>(bank)
+{
+}
+
+CroArrowWriter& CroExportArrow::Writer(CroBase* base,
+    CroColumnBatch& batch, CroSync* out)
+{
+    auto& writer = m_Writers[base->m_BaseIndex];
+    if (!writer)
+        writer = std::make_unique<CroArrowWriter>(batch, out);
+    return *writer;
+}
+
+void CroExportArrow::OnBatch(CroBase* base, CroColumnBatch& batch,
+    CroSync* out)
+{
+    Writer(base, batch, out).WriteBatch(batch);
+}
+
+void CroExportArrow::OnBatchEnd(CroBase* base, CroColumnBatch& batch,
+    CroSync* out)
+{
+    Writer(base, batch, out).Close();
+}
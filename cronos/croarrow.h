@@ -0,0 +1,65 @@
+#ifndef __CROARROW_H
+#define __CROARROW_H
+
+#include "croexport.h"
+#include "crocolumn.h"
+#include "crosync.h"
+#include <memory>
+#include <vector>
+#include <map>
+
+#define CROARROW_MAGIC          "ARROW1"
+#define CROARROW_CONTINUATION   0xFFFFFFFF
+#define CROARROW_ALIGN          8
+
+struct croarrow_block {
+    int64_t m_Offset;
+    int32_t m_MetaLength;
+    int32_t m_Pad;
+    int64_t m_BodyLength;
+};
+
+// Arrow IPC file format writer: magic, schema message, record batches,
+// end-of-stream marker and footer. The stream part is readable by
+// stream readers once the 8-byte magic prefix is skipped.
+class CroArrowWriter
+{
+public:
+    CroArrowWriter(const CroColumnBatch& schema, CroSync* out);
+
+    void WriteSchema();
+    void WriteBatch(const CroColumnBatch& batch);
+    void Close();
+
+    inline bool IsClosed() const { return m_bClosed; }
+private:
+    void WriteData(const void* data, cronos_size size);
+    void WritePadding(cronos_size size);
+    int32_t WriteMessage(const std::vector<uint8_t>& meta);
+
+    std::vector<std::pair<std::string, crocolumn_type>> m_Schema;
+    CroSync* m_pOut;
+    cronos_off m_Offset;
+
+    std::vector<croarrow_block> m_Blocks;
+    bool m_bSchema;
+    bool m_bClosed;
+};
+
+class CroExportArrow : public CroExportColumns<CroExportFormat::Arrow>
+{
+public:
+    CroExportArrow(CroBank* bank);
+protected:
+    void OnBatch(CroBase* base, CroColumnBatch& batch,
+        CroSync* out) override;
+    void OnBatchEnd(CroBase* base, CroColumnBatch& batch,
+        CroSync* out) override;
+private:
+    CroArrowWriter& Writer(CroBase* base, CroColumnBatch& batch,
+        CroSync* out);
+
+    std::map<CroIdent, std::unique_ptr<CroArrowWriter>> m_Writers;
+};
+
+#endif
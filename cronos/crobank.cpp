@@ -1,5 +1,7 @@
 #include "crobank.h"
+#include "crorow.h"
 #include <stdexcept>
+#include <string.h>
 #include <win32util.h>
 
 /* CroBank */
@@ -186,6 +188,138 @@ void CroBank::OnParseProp(CroProp& prop)
         m_BankVersion = atoi(prop.GetString().c_str());
 }
 
+static std::string StruString(const uint8_t*& cur, const uint8_t* end)
+{
+    uint64_t size = CroRowReadVarint(cur, end);
+    if (size > (uint64_t)(end - cur))
+        throw std::runtime_error("structure cache truncated string");
+
+    std::string str((const char*)cur, size);
+    cur += size;
+    return str;
+}
+
+void CroBank::StoreStructure(std::vector<uint8_t>& dst) const
+{
+    dst.insert(dst.end(), CROBANK_STRU_MAGIC, CROBANK_STRU_MAGIC + 6);
+    dst.push_back(CROBANK_STRU_VERSION);
+    dst.push_back(0);
+
+    std::string name = WcharToText(m_BankName);
+    std::string pass = WcharToText(m_BankSysPass);
+
+    CroRowVarint(dst, m_BankFormSaveVer);
+    CroRowVarint(dst, m_BankId);
+    CroRowString(dst, name.data(), name.size());
+    CroRowVarint(dst, m_BankSerial);
+    CroRowVarint(dst, m_BankCustomProt);
+    CroRowString(dst, pass.data(), pass.size());
+    CroRowVarint(dst, (uint32_t)m_BankVersion);
+
+    CroRowVarint(dst, m_Bases.size());
+    for (const auto& base : m_Bases)
+    {
+        CroRowVarint(dst, base.m_VocFlags);
+        CroRowVarint(dst, base.m_BaseVersion);
+        CroRowVarint(dst, base.m_BitcardId);
+        CroRowVarint(dst, base.m_LinkedId);
+        CroRowVarint(dst, base.m_BaseIndex);
+        CroRowString(dst, base.m_Name.data(), base.m_Name.size());
+        CroRowString(dst, base.m_Mnemocode.data(), base.m_Mnemocode.size());
+        CroRowVarint(dst, base.m_Flags);
+
+        CroBase& fields = const_cast<CroBase&>(base);
+        CroRowVarint(dst, fields.FieldCount());
+        for (auto it = fields.StartField(); it != fields.EndField(); it++)
+        {
+            CroRowVarint(dst, (unsigned)it->m_Type);
+            CroRowVarint(dst, it->m_Index);
+            CroRowString(dst, it->m_Name.data(), it->m_Name.size());
+            CroRowVarint(dst, it->m_Flags);
+            CroRowVarint(dst, it->m_DataIndex);
+            CroRowVarint(dst, it->m_DataLength);
+        }
+    }
+
+    CroRowVarint(dst, m_Formuls.size());
+    for (const auto& formula : m_Formuls)
+        CroRowString(dst, formula.GetData(), formula.GetSize());
+}
+
+bool CroBank::RestoreStructure(const uint8_t* data, cronos_size size)
+{
+    if (size < 8 || memcmp(data, CROBANK_STRU_MAGIC, 6)
+        || data[6] != CROBANK_STRU_VERSION)
+    {
+        return false;
+    }
+
+    const uint8_t* cur = data + 8;
+    const uint8_t* end = data + size;
+
+    try {
+        uint32_t formSaveVer = (uint32_t)CroRowReadVarint(cur, end);
+        uint32_t bankId = (uint32_t)CroRowReadVarint(cur, end);
+        std::string name = StruString(cur, end);
+        uint32_t serial = (uint32_t)CroRowReadVarint(cur, end);
+        uint32_t customProt = (uint32_t)CroRowReadVarint(cur, end);
+        std::string pass = StruString(cur, end);
+        int version = (int)(uint32_t)CroRowReadVarint(cur, end);
+
+        std::vector<CroBase> bases;
+        uint64_t baseCount = CroRowReadVarint(cur, end);
+        for (uint64_t i = 0; i < baseCount; i++)
+        {
+            CroBase& base = bases.emplace_back();
+            base.m_VocFlags = (uint16_t)CroRowReadVarint(cur, end);
+            base.m_BaseVersion = (uint16_t)CroRowReadVarint(cur, end);
+            base.m_BitcardId = (uint32_t)CroRowReadVarint(cur, end);
+            base.m_LinkedId = (uint32_t)CroRowReadVarint(cur, end);
+            base.m_BaseIndex = (uint32_t)CroRowReadVarint(cur, end);
+            base.m_Name = StruString(cur, end);
+            base.m_Mnemocode = StruString(cur, end);
+            base.m_Flags = (uint32_t)CroRowReadVarint(cur, end);
+
+            uint64_t fieldCount = CroRowReadVarint(cur, end);
+            for (uint64_t j = 0; j < fieldCount; j++)
+            {
+                CroField field;
+                field.m_Type = (CroType)CroRowReadVarint(cur, end);
+                field.m_Index = (uint32_t)CroRowReadVarint(cur, end);
+                field.m_Name = StruString(cur, end);
+                field.m_Flags = (uint32_t)CroRowReadVarint(cur, end);
+                field.m_DataIndex = (uint32_t)CroRowReadVarint(cur, end);
+                field.m_DataLength = (uint32_t)CroRowReadVarint(cur, end);
+                base.AddField(field);
+            }
+        }
+
+        std::vector<CroBuffer> formuls;
+        uint64_t formulaCount = CroRowReadVarint(cur, end);
+        for (uint64_t i = 0; i < formulaCount; i++)
+        {
+            std::string formula = StruString(cur, end);
+            formuls.emplace_back().Write((const uint8_t*)formula.data(),
+                formula.size());
+        }
+
+        m_BankFormSaveVer = formSaveVer;
+        m_BankId = bankId;
+        m_BankName = TextToWchar(name);
+        m_BankSerial = serial;
+        m_BankCustomProt = customProt;
+        m_BankSysPass = TextToWchar(pass);
+        m_BankVersion = version;
+        m_Bases = std::move(bases);
+        m_Formuls = std::move(formuls);
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+
+    return true;
+}
+
 /* CroBankParser */
 
 CroBankParser::CroBankParser(CroBank* bank)
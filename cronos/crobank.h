@@ -7,6 +7,9 @@
 
 #define CRONOS_DEFAULT_CODEPAGE 1251
 
+#define CROBANK_STRU_MAGIC      "CROSTR"
+#define CROBANK_STRU_VERSION    1
+
 class CroParser;
 
 using CroBaseIter = std::vector<CroBase>::iterator;
@@ -41,6 +44,11 @@ public:
 
     virtual void OnCronosException(const CroException& exc);
     virtual void OnParseProp(CroProp& prop);
+
+    // parsed structure in a compact form for caching, restoring fails
+    // without touching the bank when the data is not a valid structure
+    void StoreStructure(std::vector<uint8_t>& dst) const;
+    bool RestoreStructure(const uint8_t* data, cronos_size size);
 protected:
     std::wstring m_Path;
     unsigned m_TextCodePage;
@@ -0,0 +1,352 @@
+#include "croblob.h"
+#include "crofile.h"
+#include "crosync.h"
+#include "crorow.h"
+#include "croexception.h"
+#include <win32util.h>
+#include <filesystem>
+#include <stdexcept>
+#include <string.h>
+#include <stdio.h>
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+// seed of the second blob digest
+#define CROBLOB_SEED2 0x6A09E667F3BCC908ULL
+
+static inline uint64_t XxhRotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t XxhRead64(const uint8_t* p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static inline uint32_t XxhRead32(const uint8_t* p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8
+        | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t XxhRound(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    return XxhRotl(acc, 31) * XXH_PRIME64_1;
+}
+
+static inline uint64_t XxhMerge(uint64_t acc, uint64_t val)
+{
+    acc ^= XxhRound(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/* CroHash64 */
+
+CroHash64::CroHash64(uint64_t seed)
+    : m_TailSize(0), m_Total(0), m_Seed(seed)
+{
+    m_Acc[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    m_Acc[1] = seed + XXH_PRIME64_2;
+    m_Acc[2] = seed;
+    m_Acc[3] = seed - XXH_PRIME64_1;
+}
+
+void CroHash64::Update(const uint8_t* data, cronos_size size)
+{
+    m_Total += size;
+
+    if (m_TailSize + size < 32)
+    {
+        if (size) memcpy(m_Tail + m_TailSize, data, size);
+        m_TailSize += (unsigned)size;
+        return;
+    }
+
+    const uint8_t* end = data + size;
+    if (m_TailSize)
+    {
+        unsigned fill = 32 - m_TailSize;
+        memcpy(m_Tail + m_TailSize, data, fill);
+        data += fill;
+
+        for (int i = 0; i < 4; i++)
+            m_Acc[i] = XxhRound(m_Acc[i], XxhRead64(m_Tail + i * 8));
+        m_TailSize = 0;
+    }
+
+    for (; data + 32 <= end; data += 32)
+    {
+        for (int i = 0; i < 4; i++)
+            m_Acc[i] = XxhRound(m_Acc[i], XxhRead64(data + i * 8));
+    }
+
+    m_TailSize = (unsigned)(end - data);
+    if (m_TailSize) memcpy(m_Tail, data, m_TailSize);
+}
+
+uint64_t CroHash64::Digest() const
+{
+    uint64_t h;
+    if (m_Total >= 32)
+    {
+        h = XxhRotl(m_Acc[0], 1) + XxhRotl(m_Acc[1], 7)
+            + XxhRotl(m_Acc[2], 12) + XxhRotl(m_Acc[3], 18);
+        for (int i = 0; i < 4; i++)
+            h = XxhMerge(h, m_Acc[i]);
+    }
+    else h = m_Seed + XXH_PRIME64_5;
+
+    h += m_Total;
+
+    const uint8_t* p = m_Tail;
+    const uint8_t* end = m_Tail + m_TailSize;
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= XxhRound(0, XxhRead64(p));
+        h = XxhRotl(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (p + 4 <= end)
+    {
+        h ^= (uint64_t)XxhRead32(p) * XXH_PRIME64_1;
+        h = XxhRotl(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        h ^= *p * XXH_PRIME64_5;
+        h = XxhRotl(h, 11) * XXH_PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* CroBlobStore */
+
+CroBlobStore::CroBlobStore(const std::wstring& root,
+    const std::wstring& indexPath)
+    : m_Root(root), m_IndexPath(indexPath), m_bOpen(false)
+{
+}
+
+void CroBlobStore::Open()
+{
+    if (m_bOpen) return;
+
+    std::filesystem::create_directories(m_Root);
+    Load();
+    m_bOpen = true;
+}
+
+std::wstring CroBlobStore::BlobPath(uint64_t hash, uint64_t hash2,
+    cronos_size size) const
+{
+    char szName[64];
+    sprintf(szName, "%016llx%016llx-%llx", (unsigned long long)hash,
+        (unsigned long long)hash2, (unsigned long long)size);
+
+    std::wstring name = TextToWchar(szName);
+    return JoinFilePath(JoinFilePath(JoinFilePath(m_Root,
+        name.substr(0, 2)), name.substr(2, 2)), name);
+}
+
+const croblob_entry* CroBlobStore::GetEntry(cronos_id id)
+{
+    Open();
+
+    auto it = m_Entries.find(id);
+    return it != m_Entries.end() ? &it->second : NULL;
+}
+
+void CroBlobStore::Publish(const std::wstring& tmpPath,
+    const std::wstring& path)
+{
+    std::filesystem::path blob = path;
+    std::filesystem::create_directories(blob.parent_path());
+
+    // an identical blob renamed by another export in between is fine
+    std::filesystem::rename(tmpPath, blob);
+}
+
+const croblob_entry& CroBlobStore::Store(CroFile* file, cronos_id id,
+    const CroEntry& entry)
+{
+    Open();
+
+    auto it = m_Entries.find(id);
+    if (it != m_Entries.end()
+        && it->second.m_Offset == entry.EntryOffset()
+        && it->second.m_Size == entry.EntrySize()
+        && it->second.m_Flags == entry.EntryFlags()
+        && std::filesystem::exists(BlobPath(it->second.m_Hash,
+            it->second.m_Hash2, it->second.m_BlobSize)))
+    {
+        return it->second;
+    }
+
+    CroFileRecord rec = file->ReadFileRecord(entry);
+    CroHash64 hash;
+    CroHash64 hash2(CROBLOB_SEED2);
+    cronos_size size = 0;
+
+    char szTmp[64];
+    sprintf(szTmp, "tmp-%p-%llu", (void*)this, (unsigned long long)id);
+    std::wstring tmpPath = JoinFilePath(m_Root, TextToWchar(szTmp));
+    std::wstring path;
+
+    try {
+        if (!file->IsEncrypted() && !file->IsCompressed())
+        {
+            // hash first, copy in the kernel only what is not stored yet
+            file->StreamRecord(id, rec,
+                [&](const uint8_t* data, cronos_size part) {
+                    hash.Update(data, part);
+                    hash2.Update(data, part);
+                    size += part;
+                });
+
+            path = BlobPath(hash.Digest(), hash2.Digest(), size);
+            if (!std::filesystem::exists(path))
+            {
+                CroSyncFile tmp(tmpPath, CROBLOB_BUFFER, CROSYNC_TRUNCATE);
+                file->StreamRecord(id, rec, tmp);
+                tmp.Close();
+
+                Publish(tmpPath, path);
+            }
+        }
+        else
+        {
+            // decoding twice costs more than writing a duplicate once
+            {
+                CroSyncFile tmp(tmpPath, CROBLOB_BUFFER, CROSYNC_TRUNCATE);
+                file->StreamRecord(id, rec,
+                    [&](const uint8_t* data, cronos_size part) {
+                        hash.Update(data, part);
+                        hash2.Update(data, part);
+                        tmp.Write(data, part);
+                        size += part;
+                    });
+                tmp.Close();
+            }
+
+            path = BlobPath(hash.Digest(), hash2.Digest(), size);
+            if (std::filesystem::exists(path))
+                std::filesystem::remove(tmpPath);
+            else
+                Publish(tmpPath, path);
+        }
+    }
+    catch (...) {
+        std::error_code ec;
+        std::filesystem::remove(tmpPath, ec);
+        throw;
+    }
+
+    croblob_entry& blob = m_Entries[id];
+    blob.m_Offset = entry.EntryOffset();
+    blob.m_Size = entry.EntrySize();
+    blob.m_Flags = entry.EntryFlags();
+    blob.m_BlobSize = size;
+    blob.m_Hash = hash.Digest();
+    blob.m_Hash2 = hash2.Digest();
+    return blob;
+}
+
+bool CroBlobStore::Load()
+{
+    FILE* fp = _wfopen(m_IndexPath.c_str(), L"rb");
+    if (!fp) return false;
+
+    std::vector<uint8_t> data;
+    uint8_t chunk[65536];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+        data.insert(data.end(), chunk, chunk + read);
+    fclose(fp);
+
+    // older indexes name blobs by one digest, store them again
+    if (data.size() < 8 || memcmp(data.data(), CROBLOB_MAGIC, 6)
+        || data[6] != CROBLOB_VERSION)
+    {
+        return false;
+    }
+
+    const uint8_t* cur = data.data() + 8;
+    const uint8_t* end = data.data() + data.size();
+
+    try {
+        uint64_t count = CroRowReadVarint(cur, end);
+        cronos_id id = 0;
+        for (uint64_t i = 0; i < count; i++)
+        {
+            id += (cronos_id)CroRowReadVarint(cur, end);
+
+            croblob_entry& blob = m_Entries[id];
+            blob.m_Offset = (cronos_off)CroRowReadVarint(cur, end);
+            blob.m_Size = (cronos_size)CroRowReadVarint(cur, end);
+            blob.m_Flags = (cronos_flags)CroRowReadVarint(cur, end);
+            blob.m_BlobSize = (cronos_size)CroRowReadVarint(cur, end);
+
+            if (end - cur < 16)
+                throw std::runtime_error("croblob truncated hash");
+            memcpy(&blob.m_Hash, cur, 8);
+            memcpy(&blob.m_Hash2, cur + 8, 8);
+            cur += 16;
+        }
+    }
+    catch (const std::exception&) {
+        m_Entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void CroBlobStore::Save() const
+{
+    if (!m_bOpen) return;
+
+    std::vector<uint8_t> data(CROBLOB_MAGIC, CROBLOB_MAGIC + 6);
+    data.push_back(CROBLOB_VERSION);
+    data.push_back(0);
+    CroRowVarint(data, m_Entries.size());
+
+    cronos_id last = 0;
+    for (const auto& [id, blob] : m_Entries)
+    {
+        CroRowVarint(data, id - last);
+        CroRowVarint(data, blob.m_Offset);
+        CroRowVarint(data, blob.m_Size);
+        CroRowVarint(data, blob.m_Flags);
+        CroRowVarint(data, blob.m_BlobSize);
+
+        const uint8_t* hash = (const uint8_t*)&blob.m_Hash;
+        data.insert(data.end(), hash, hash + 8);
+        hash = (const uint8_t*)&blob.m_Hash2;
+        data.insert(data.end(), hash, hash + 8);
+        last = id;
+    }
+
+    std::wstring tmpPath = m_IndexPath + L".tmp";
+    FILE* fp = _wfopen(tmpPath.c_str(), L"wb");
+    if (!fp) throw std::runtime_error("failed to create blob index");
+
+    bool ok = fwrite(data.data(), data.size(), 1, fp) == 1;
+    ok = !fclose(fp) && ok;
+    if (!ok) throw std::runtime_error("failed to write blob index");
+
+    std::filesystem::rename(tmpPath, m_IndexPath);
+}
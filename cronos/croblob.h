@@ -0,0 +1,76 @@
+#ifndef __CROBLOB_H
+#define __CROBLOB_H
+
+#include "crotype.h"
+#include <string>
+#include <map>
+
+#define CROBLOB_MAGIC           "CROBLB"
+#define CROBLOB_VERSION         2
+#define CROBLOB_INDEX_FILE      L"files.index"
+#define CROBLOB_BUFFER          (1024*1024)
+
+class CroFile;
+class CroEntry;
+
+// Streaming XXH64
+class CroHash64
+{
+public:
+    CroHash64(uint64_t seed = 0);
+
+    void Update(const uint8_t* data, cronos_size size);
+    uint64_t Digest() const;
+private:
+    uint64_t m_Acc[4];
+    uint8_t m_Tail[32];
+    unsigned m_TailSize;
+    uint64_t m_Total;
+    uint64_t m_Seed;
+};
+
+struct croblob_entry {
+    cronos_off m_Offset;
+    cronos_size m_Size;
+    cronos_flags m_Flags;
+    cronos_size m_BlobSize;
+    uint64_t m_Hash;
+    uint64_t m_Hash2;
+};
+
+// Attached files stored once by content as root/xx/yy/<hash><hash2>-<size>,
+// shared by all banks exported to the same root. The two XXH64 digests
+// use different seeds, a blob is only shared when both and the size
+// match. The index of a bank maps record ids to blobs and keeps the TAD
+// entry each blob was read from, so records that did not change are not
+// read again.
+// Index file: "CROBLB" version 2, entry count, then per entry the id
+// delta, TAD offset, size, flags and blob size as varints and both
+// hashes as 8 little endian bytes each.
+// Nothing is created or read before the first attachment is looked up
+// or stored, Save of a store never opened writes nothing.
+class CroBlobStore
+{
+public:
+    CroBlobStore(const std::wstring& root, const std::wstring& indexPath);
+
+    inline const std::wstring& GetRoot() const { return m_Root; }
+    std::wstring BlobPath(uint64_t hash, uint64_t hash2,
+        cronos_size size) const;
+    const croblob_entry* GetEntry(cronos_id id);
+
+    const croblob_entry& Store(CroFile* file, cronos_id id,
+        const CroEntry& entry);
+    void Save() const;
+private:
+    void Open();
+    bool Load();
+    void Publish(const std::wstring& tmpPath, const std::wstring& path);
+
+    std::wstring m_Root;
+    std::wstring m_IndexPath;
+    std::map<cronos_id, croblob_entry> m_Entries;
+    bool m_bOpen;
+};
+
+#endif
@@ -0,0 +1,239 @@
+#include "crocodec.h"
+#include <stdexcept>
+#include <algorithm>
+#include <string.h>
+#include <zlib.h>
+#ifdef CRONOS_ZSTD
+#include <zstd.h>
+#endif
+
+#define SNAPPY_HASH_BITS    14
+#define SNAPPY_MAX_OFFSET   0xFFFF
+#define SNAPPY_MIN_MATCH    4
+
+static void SnappyVarint(std::vector<uint8_t>& dst, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        dst.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    dst.push_back((uint8_t)value);
+}
+
+static void SnappyLiteral(std::vector<uint8_t>& dst,
+    const uint8_t* src, cronos_size size)
+{
+    cronos_size len = size - 1;
+    if (len < 60)
+    {
+        dst.push_back((uint8_t)(len << 2));
+    }
+    else
+    {
+        unsigned bytes = len < 0x100 ? 1 : len < 0x10000 ? 2
+            : len < 0x1000000 ? 3 : 4;
+
+        dst.push_back((uint8_t)((59 + bytes) << 2));
+        for (unsigned i = 0; i < bytes; i++)
+            dst.push_back((uint8_t)(len >> (8 * i)));
+    }
+
+    dst.insert(dst.end(), src, src + size);
+}
+
+static void SnappyCopy(std::vector<uint8_t>& dst,
+    cronos_size offset, cronos_size size)
+{
+    while (size)
+    {
+        cronos_size len = std::min<cronos_size>(size, 64);
+
+        dst.push_back((uint8_t)(((len - 1) << 2) | 2));
+        dst.push_back((uint8_t)offset);
+        dst.push_back((uint8_t)(offset >> 8));
+        size -= len;
+    }
+}
+
+static void SnappyCompress(const uint8_t* src, cronos_size size,
+    std::vector<uint8_t>& dst)
+{
+    std::vector<uint32_t> table(1 << SNAPPY_HASH_BITS, 0);
+    cronos_size lit = 0, pos = 0;
+
+    SnappyVarint(dst, size);
+    while (pos + SNAPPY_MIN_MATCH <= size)
+    {
+        uint32_t word;
+        memcpy(&word, src + pos, sizeof(word));
+
+        uint32_t hash = (word * 0x1E35A7BD) >> (32 - SNAPPY_HASH_BITS);
+        cronos_size cand = table[hash];
+        table[hash] = (uint32_t)(pos + 1);
+
+        if (!cand || pos - (cand - 1) > SNAPPY_MAX_OFFSET
+            || memcmp(src + cand - 1, src + pos, SNAPPY_MIN_MATCH))
+        {
+            pos++;
+            continue;
+        }
+
+        cronos_size match = cand - 1, len = SNAPPY_MIN_MATCH;
+        while (pos + len < size && src[match + len] == src[pos + len])
+            len++;
+
+        if (pos > lit) SnappyLiteral(dst, src + lit, pos - lit);
+        SnappyCopy(dst, pos - match, len);
+
+        pos += len;
+        lit = pos;
+    }
+
+    if (size > lit) SnappyLiteral(dst, src + lit, size - lit);
+}
+
+static void GzipCompress(const uint8_t* src, cronos_size size,
+    std::vector<uint8_t>& dst, int level)
+{
+    z_stream def;
+    memset(&def, '\0', sizeof(def));
+
+    if (level < 0) level = Z_DEFAULT_COMPRESSION;
+    if (deflateInit2(&def, level, Z_DEFLATED, 15 + 16, 8,
+        Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        throw std::runtime_error("gzip deflateInit2 failed");
+    }
+
+    size_t start = dst.size();
+    dst.resize(start + deflateBound(&def, (uLong)size));
+
+    def.next_in = (Bytef*)src;
+    def.avail_in = (uInt)size;
+    def.next_out = dst.data() + start;
+    def.avail_out = (uInt)(dst.size() - start);
+
+    int ret = deflate(&def, Z_FINISH);
+    dst.resize(start + def.total_out);
+    deflateEnd(&def);
+
+    if (ret != Z_STREAM_END)
+        throw std::runtime_error("gzip deflate failed");
+}
+
+#ifdef CRONOS_ZSTD
+static void ZstdCompress(const uint8_t* src, cronos_size size,
+    std::vector<uint8_t>& dst, int level)
+{
+    size_t start = dst.size();
+    dst.resize(start + ZSTD_compressBound(size));
+
+    size_t ret = ZSTD_compress(dst.data() + start, dst.size() - start,
+        src, size, level < 0 ? ZSTD_CLEVEL_DEFAULT : level);
+    if (ZSTD_isError(ret))
+        throw std::runtime_error(ZSTD_getErrorName(ret));
+
+    dst.resize(start + ret);
+}
+#endif
+
+bool CroCodecAvailable(crocodec_type codec)
+{
+    switch (codec)
+    {
+    case CroCodec_None:
+    case CroCodec_Snappy:
+    case CroCodec_Gzip:
+        return true;
+#ifdef CRONOS_ZSTD
+    case CroCodec_Zstd:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+void CroCompress(crocodec_type codec, const uint8_t* src, cronos_size size,
+    std::vector<uint8_t>& dst, int level)
+{
+    switch (codec)
+    {
+    case CroCodec_None:
+        dst.insert(dst.end(), src, src + size);
+        break;
+    case CroCodec_Snappy:
+        SnappyCompress(src, size, dst);
+        break;
+    case CroCodec_Gzip:
+        GzipCompress(src, size, dst, level);
+        break;
+#ifdef CRONOS_ZSTD
+    case CroCodec_Zstd:
+        ZstdCompress(src, size, dst, level);
+        break;
+#endif
+    default:
+        throw std::runtime_error("compression codec is not available");
+    }
+}
+
+/* CroCodecPool */
+
+CroCodecPool::CroCodecPool(unsigned threads)
+    : m_bStop(false)
+{
+    if (!threads) threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (unsigned i = 0; i < threads; i++)
+        m_Threads.emplace_back(&CroCodecPool::Run, this);
+}
+
+CroCodecPool::~CroCodecPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_bStop = true;
+    }
+
+    m_Cond.notify_all();
+    for (auto& thread : m_Threads)
+        thread.join();
+}
+
+std::future<void> CroCodecPool::Compress(crocodec_type codec,
+    const uint8_t* src, cronos_size size, std::vector<uint8_t>& dst,
+    int level)
+{
+    std::packaged_task<void()> job([codec, src, size, &dst, level] {
+        CroCompress(codec, src, size, dst, level);
+    });
+    std::future<void> done = job.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Jobs.push_back(std::move(job));
+    }
+
+    m_Cond.notify_one();
+    return done;
+}
+
+void CroCodecPool::Run()
+{
+    for (;;)
+    {
+        std::packaged_task<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(m_Lock);
+            m_Cond.wait(lock, [this] { return m_bStop || !m_Jobs.empty(); });
+            if (m_Jobs.empty()) return;
+
+            job = std::move(m_Jobs.front());
+            m_Jobs.pop_front();
+        }
+
+        job();
+    }
+}
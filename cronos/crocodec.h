@@ -0,0 +1,52 @@
+#ifndef __CROCODEC_H
+#define __CROCODEC_H
+
+#include "crotype.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <condition_variable>
+
+#define CROCODEC_DEFAULT_LEVEL -1
+
+enum crocodec_type {
+    CroCodec_None,
+    CroCodec_Snappy,
+    CroCodec_Gzip,
+    CroCodec_Zstd
+};
+
+bool CroCodecAvailable(crocodec_type codec);
+
+// Appends the compressed form of src to dst. Gzip produces a complete
+// gzip member, Zstd a complete frame and Snappy a raw snappy block.
+void CroCompress(crocodec_type codec, const uint8_t* src, cronos_size size,
+    std::vector<uint8_t>& dst, int level = CROCODEC_DEFAULT_LEVEL);
+
+// Fixed set of threads compressing independent blocks, one thread per
+// core by default. Completion is reported through the returned future,
+// so callers can keep several blocks in flight and collect them in order.
+class CroCodecPool
+{
+public:
+    CroCodecPool(unsigned threads = 0);
+    ~CroCodecPool();
+
+    inline unsigned ThreadCount() const { return (unsigned)m_Threads.size(); }
+
+    std::future<void> Compress(crocodec_type codec, const uint8_t* src,
+        cronos_size size, std::vector<uint8_t>& dst,
+        int level = CROCODEC_DEFAULT_LEVEL);
+private:
+    void Run();
+
+    std::mutex m_Lock;
+    std::condition_variable m_Cond;
+    std::deque<std::packaged_task<void()>> m_Jobs;
+    bool m_bStop;
+    std::vector<std::thread> m_Threads;
+};
+
+#endif
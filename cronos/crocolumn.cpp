@@ -0,0 +1,140 @@
+#include "crocolumn.h"
+#include "crostru.h"
+#include <win32util.h>
+#include <set>
+
+crocolumn_type CroColumnType(CroType type)
+{
+    switch (type)
+    {
+    case CroType::Ident:
+    case CroType::Integer:
+        return CroColumn_Integer;
+    case CroType::Date:
+        return CroColumn_Date;
+    case CroType::Time:
+        return CroColumn_Time;
+    default:
+        return CroColumn_Text;
+    }
+}
+
+std::vector<std::string> CroColumnNames(CroBase* base, unsigned codepage)
+{
+    std::vector<std::string> names;
+    std::set<std::string> used;
+
+    unsigned idx = 0;
+    for (auto it = base->StartField(); it != base->EndField(); it++, idx++)
+    {
+        std::string name = WcharToText(AnsiToWchar(it->GetName(), codepage));
+        if (name.empty()) name = "field" + std::to_string(idx);
+        if (!used.insert(name).second)
+        {
+            name += "_" + std::to_string(idx);
+            used.insert(name);
+        }
+
+        names.push_back(name);
+    }
+
+    return names;
+}
+
+std::string CroTableName(CroBase* base, unsigned codepage)
+{
+    std::string name = WcharToText(AnsiToWchar(base->GetName(), codepage));
+    return name.empty() ? "base" + std::to_string(base->m_BaseIndex) : name;
+}
+
+/* CroColumn */
+
+CroColumn::CroColumn(const std::string& name, crocolumn_type type)
+    : m_Name(name), m_Type(type)
+{
+    Reset();
+}
+
+void CroColumn::Append(const CroExportValue& value)
+{
+    m_Null.push_back(value.m_bNull);
+    if (value.m_bNull) m_NullCount++;
+
+    if (m_Type == CroColumn_Text)
+    {
+        if (!value.m_bNull) m_Text.append(value.m_Text);
+        m_Offsets.push_back((uint32_t)m_Text.size());
+    }
+    else
+    {
+        m_Integer.push_back(value.m_bNull ? 0 : value.m_Integer);
+    }
+}
+
+void CroColumn::Reset()
+{
+    m_Null.clear();
+    m_Integer.clear();
+    m_Offsets.clear();
+    m_Text.clear();
+
+    if (m_Type == CroColumn_Text)
+        m_Offsets.push_back(0);
+    m_NullCount = 0;
+}
+
+cronos_size CroColumn::ByteSize() const
+{
+    return m_Null.size()
+        + m_Integer.size() * sizeof(CroInteger)
+        + m_Offsets.size() * sizeof(uint32_t)
+        + m_Text.size();
+}
+
+/* CroColumnBatch */
+
+CroColumnBatch::CroColumnBatch()
+{
+    m_RowCount = 0;
+}
+
+void CroColumnBatch::InitBatch(CroBase* base, unsigned codepage)
+{
+    std::vector<std::string> names = CroColumnNames(base, codepage);
+
+    m_Columns.clear();
+    m_RowCount = 0;
+
+    unsigned idx = 0;
+    for (auto it = base->StartField(); it != base->EndField(); it++)
+        AddColumn(names[idx++], CroColumnType(it->GetType()));
+}
+
+void CroColumnBatch::AddColumn(const std::string& name, crocolumn_type type)
+{
+    m_Columns.emplace_back(name, type);
+}
+
+void CroColumnBatch::AppendRow(const CroExportRow& row)
+{
+    static const CroExportValue nullValue = { true, 0, "" };
+
+    for (unsigned i = 0; i < m_Columns.size(); i++)
+        m_Columns[i].Append(i < row.size() ? row[i] : nullValue);
+    m_RowCount++;
+}
+
+void CroColumnBatch::Reset()
+{
+    for (auto& column : m_Columns)
+        column.Reset();
+    m_RowCount = 0;
+}
+
+cronos_size CroColumnBatch::ByteSize() const
+{
+    cronos_size size = 0;
+    for (const auto& column : m_Columns)
+        size += column.ByteSize();
+    return size;
+}
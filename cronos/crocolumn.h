@@ -0,0 +1,84 @@
+#ifndef __CROCOLUMN_H
+#define __CROCOLUMN_H
+
+#include "crotype.h"
+#include <string>
+#include <vector>
+
+class CroBase;
+
+enum crocolumn_type {
+    CroColumn_Integer,
+    CroColumn_Text,
+    CroColumn_Date,
+    CroColumn_Time
+};
+
+crocolumn_type CroColumnType(CroType type);
+
+// UTF-8 field names of a base, empty names are replaced and duplicates
+// get the field position appended so they can be used as column names
+std::vector<std::string> CroColumnNames(CroBase* base, unsigned codepage);
+std::string CroTableName(CroBase* base, unsigned codepage);
+
+// Integer holds the value for Ident/Integer, days since 1970-01-01
+// for Date and milliseconds since midnight for Time
+struct CroExportValue {
+    bool m_bNull;
+    CroInteger m_Integer;
+    std::string m_Text;
+};
+
+using CroExportRow = std::vector<CroExportValue>;
+
+class CroColumn
+{
+public:
+    CroColumn(const std::string& name, crocolumn_type type);
+
+    inline const std::string& ColumnName() const { return m_Name; }
+    inline crocolumn_type ColumnType() const { return m_Type; }
+    inline cronos_idx RowCount() const { return (cronos_idx)m_Null.size(); }
+    inline cronos_idx NullCount() const { return m_NullCount; }
+    inline bool IsNull(cronos_idx row) const { return m_Null[row]; }
+
+    void Append(const CroExportValue& value);
+    void Reset();
+    cronos_size ByteSize() const;
+
+    // one slot per row, nulls included
+    std::vector<uint8_t> m_Null;
+    std::vector<CroInteger> m_Integer;
+    std::vector<uint32_t> m_Offsets;
+    std::string m_Text;
+private:
+    std::string m_Name;
+    crocolumn_type m_Type;
+    cronos_idx m_NullCount;
+};
+
+class CroColumnBatch
+{
+public:
+    CroColumnBatch();
+
+    void InitBatch(CroBase* base, unsigned codepage);
+    void AddColumn(const std::string& name, crocolumn_type type);
+
+    inline cronos_idx RowCount() const { return m_RowCount; }
+    inline bool IsEmpty() const { return !m_RowCount; }
+    inline unsigned ColumnCount() const { return (unsigned)m_Columns.size(); }
+    inline const CroColumn& Column(unsigned idx) const
+    {
+        return m_Columns[idx];
+    }
+
+    void AppendRow(const CroExportRow& row);
+    void Reset();
+    cronos_size ByteSize() const;
+private:
+    std::vector<CroColumn> m_Columns;
+    cronos_idx m_RowCount;
+};
+
+#endif
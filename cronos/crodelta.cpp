@@ -0,0 +1,212 @@
+#include "crodelta.h"
+#include "croentry.h"
+#include "crorow.h"
+#include <win32util.h>
+#include <filesystem>
+#include <stdexcept>
+#include <string.h>
+#include <stdio.h>
+
+static uint64_t DeltaVarint(const uint8_t*& cur, const uint8_t* end)
+{
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        if (cur >= end)
+            throw std::runtime_error("crodelta truncated varint");
+
+        uint8_t byte = *cur++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+
+    throw std::runtime_error("crodelta bad varint");
+}
+
+static inline uint64_t DeltaMix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t CroDeltaHash(const uint8_t* data, cronos_size size)
+{
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ size;
+
+    cronos_size i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        h = (h ^ DeltaMix(word)) * 0x9E3779B97F4A7C15ULL;
+    }
+
+    uint64_t tail = 0;
+    if (i < size) memcpy(&tail, data + i, size - i);
+    return DeltaMix(h ^ tail);
+}
+
+/* CroDeltaIndex */
+
+CroDeltaIndex::CroDeltaIndex(bool hash)
+    : m_bHash(hash)
+{
+}
+
+bool CroDeltaIndex::Load(const std::wstring& path)
+{
+    FILE* fp = _wfopen(path.c_str(), L"rb");
+    if (!fp) return false;
+
+    std::vector<uint8_t> data;
+    uint8_t chunk[65536];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+        data.insert(data.end(), chunk, chunk + read);
+    fclose(fp);
+
+    if (data.size() < 8 || memcmp(data.data(), CRODELTA_MAGIC, 6)
+        || data[6] > CRODELTA_VERSION)
+    {
+        return false;
+    }
+
+    const uint8_t* cur = data.data() + 8;
+    const uint8_t* end = data.data() + data.size();
+    m_bHash = data[7] & CRODELTA_HASH;
+    m_Entries.clear();
+
+    try {
+        uint64_t count = DeltaVarint(cur, end);
+        cronos_id id = 0;
+        for (uint64_t i = 0; i < count; i++)
+        {
+            id += (cronos_id)DeltaVarint(cur, end);
+            if (id > m_Entries.size())
+                m_Entries.resize(id, { INVALID_CRONOS_OFFSET, 0, 0, 0, 0 });
+
+            crodelta_entry& entry = m_Entries[id - 1];
+            entry.m_Offset = (cronos_off)DeltaVarint(cur, end);
+            entry.m_Size = (cronos_size)DeltaVarint(cur, end);
+            entry.m_Flags = (cronos_flags)DeltaVarint(cur, end);
+            entry.m_Base = (CroIdent)DeltaVarint(cur, end);
+            entry.m_Hash = 0;
+
+            if (m_bHash)
+            {
+                if (end - cur < 8)
+                    throw std::runtime_error("crodelta truncated hash");
+                memcpy(&entry.m_Hash, cur, 8);
+                cur += 8;
+            }
+        }
+    }
+    catch (const std::exception&) {
+        m_Entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void CroDeltaIndex::Save(const std::wstring& path) const
+{
+    std::vector<uint8_t> data(CRODELTA_MAGIC, CRODELTA_MAGIC + 6);
+    data.push_back(CRODELTA_VERSION);
+    data.push_back(m_bHash ? CRODELTA_HASH : 0);
+
+    uint64_t count = 0;
+    for (const auto& entry : m_Entries)
+        if (entry.m_Offset != INVALID_CRONOS_OFFSET) count++;
+    CroRowVarint(data, count);
+
+    cronos_id last = 0;
+    for (cronos_id id = 1; id < IdEnd(); id++)
+    {
+        const crodelta_entry& entry = m_Entries[id - 1];
+        if (entry.m_Offset == INVALID_CRONOS_OFFSET) continue;
+
+        CroRowVarint(data, id - last);
+        CroRowVarint(data, entry.m_Offset);
+        CroRowVarint(data, entry.m_Size);
+        CroRowVarint(data, entry.m_Flags);
+        CroRowVarint(data, entry.m_Base);
+        if (m_bHash)
+        {
+            const uint8_t* hash = (const uint8_t*)&entry.m_Hash;
+            data.insert(data.end(), hash, hash + 8);
+        }
+
+        last = id;
+    }
+
+    // replace the old index only once the new one is complete
+    std::wstring tmpPath = path + L".tmp";
+    FILE* fp = _wfopen(tmpPath.c_str(), L"wb");
+    if (!fp) throw std::runtime_error("failed to create delta index");
+
+    bool ok = fwrite(data.data(), data.size(), 1, fp) == 1;
+    ok = !fclose(fp) && ok;
+    if (!ok) throw std::runtime_error("failed to write delta index");
+
+    std::filesystem::rename(tmpPath, path);
+}
+
+bool CroDeltaIndex::HasEntry(cronos_id id) const
+{
+    return id && id < IdEnd()
+        && m_Entries[id - 1].m_Offset != INVALID_CRONOS_OFFSET;
+}
+
+const crodelta_entry& CroDeltaIndex::GetEntry(cronos_id id) const
+{
+    return m_Entries.at(id - 1);
+}
+
+crodelta_entry& CroDeltaIndex::SetEntry(cronos_id id, const CroEntry& entry)
+{
+    if (id >= IdEnd())
+        m_Entries.resize(id, { INVALID_CRONOS_OFFSET, 0, 0, 0, 0 });
+
+    crodelta_entry& delta = m_Entries[id - 1];
+    delta.m_Offset = entry.EntryOffset();
+    delta.m_Size = entry.EntrySize();
+    delta.m_Flags = entry.EntryFlags();
+    delta.m_Base = INVALID_CRONOS_IDENT;
+    delta.m_Hash = 0;
+    return delta;
+}
+
+void CroDeltaIndex::SetBase(cronos_id id, CroIdent base, uint64_t hash)
+{
+    if (!HasEntry(id)) return;
+
+    m_Entries[id - 1].m_Base = base;
+    m_Entries[id - 1].m_Hash = hash;
+}
+
+void CroDeltaIndex::RemoveEntry(cronos_id id)
+{
+    if (HasEntry(id))
+        m_Entries[id - 1].m_Offset = INVALID_CRONOS_OFFSET;
+}
+
+crodelta_change CroDeltaIndex::Compare(cronos_id id,
+    const CroEntry& entry) const
+{
+    if (!HasEntry(id)) return CroDelta_Insert;
+
+    const crodelta_entry& delta = m_Entries[id - 1];
+    if (delta.m_Offset != entry.EntryOffset()
+        || delta.m_Size != entry.EntrySize()
+        || delta.m_Flags != entry.EntryFlags())
+    {
+        return CroDelta_Update;
+    }
+
+    return CroDelta_None;
+}
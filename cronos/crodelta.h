@@ -0,0 +1,62 @@
+#ifndef __CRODELTA_H
+#define __CRODELTA_H
+
+#include "crotype.h"
+#include <string>
+#include <vector>
+
+#define CRODELTA_MAGIC          "CRODLT"
+#define CRODELTA_VERSION        1
+#define CRODELTA_HASH           (1 << 0)
+#define CRODELTA_INDEX_FILE     L"delta.index"
+
+// Index file: "CRODLT" version flags, entry count, then per entry the id
+// delta, TAD offset, size, flags, base index as varints and the content
+// hash as 8 little endian bytes when CRODELTA_HASH is set.
+
+class CroEntry;
+
+struct crodelta_entry {
+    cronos_off m_Offset;
+    cronos_size m_Size;
+    cronos_flags m_Flags;
+    CroIdent m_Base;
+    uint64_t m_Hash;
+};
+
+enum crodelta_change {
+    CroDelta_None,
+    CroDelta_Insert,
+    CroDelta_Update,
+    CroDelta_Delete
+};
+
+uint64_t CroDeltaHash(const uint8_t* data, cronos_size size);
+
+// Fingerprints of the records of an exported bank, indexed by record id.
+// Comparing the TAD entry catches moved, resized and reflagged records,
+// the optional content hash also catches records rewritten in place.
+class CroDeltaIndex
+{
+public:
+    CroDeltaIndex(bool hash = false);
+
+    inline bool HasHash() const { return m_bHash; }
+    inline cronos_id IdEnd() const { return m_Entries.size() + 1; }
+
+    bool Load(const std::wstring& path);
+    void Save(const std::wstring& path) const;
+
+    bool HasEntry(cronos_id id) const;
+    const crodelta_entry& GetEntry(cronos_id id) const;
+    crodelta_entry& SetEntry(cronos_id id, const CroEntry& entry);
+    void SetBase(cronos_id id, CroIdent base, uint64_t hash = 0);
+    void RemoveEntry(cronos_id id);
+
+    crodelta_change Compare(cronos_id id, const CroEntry& entry) const;
+private:
+    std::vector<crodelta_entry> m_Entries;
+    bool m_bHash;
+};
+
+#endif
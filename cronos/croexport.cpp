@@ -1,4 +1,6 @@
 #include "croexport.h"
+#include "crorow.h"
+#include "croblob.h"
 #include <win32util.h>
 
 #include <stdio.h>
@@ -7,9 +9,50 @@
 
 /* CroExport */
 
+static CroInteger DaysFromCivil(int year, unsigned mon, unsigned day)
+{
+    year -= mon <= 2;
+    const int era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yoe = (unsigned)(year - era * 400);
+    const unsigned doy = (153 * (mon > 2 ? mon - 3 : mon + 9) + 2) / 5
+        + day - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return (CroInteger)era * 146097 + (CroInteger)doe - 719468;
+}
+
+// Optional sign and digits only, blanks padding either side allowed.
+// Anything else, or a value out of CroInteger range, is no number.
+static bool ParseInteger(const uint8_t* value, cronos_size size,
+    CroInteger& out)
+{
+    cronos_size i = 0, end = size;
+    while (i < end && value[i] == ' ') i++;
+    while (end > i && value[end - 1] == ' ') end--;
+
+    bool negative = false;
+    if (i < end && (value[i] == '-' || value[i] == '+'))
+        negative = value[i++] == '-';
+    if (i == end) return false;
+
+    const uint64_t limit = negative
+        ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    uint64_t number = 0;
+    for (; i < end; i++)
+    {
+        unsigned digit = (unsigned)value[i] - '0';
+        if (digit > 9 || number > (limit - digit) / 10)
+            return false;
+        number = number * 10 + digit;
+    }
+
+    out = negative ? (CroInteger)(0 - number) : (CroInteger)number;
+    return true;
+}
+
 template<CroExportFormat F>
 CroExport<F>::CroExport(CroBank* bank)
-    : CroReader(bank), m_pOut(NULL)
+    : CroReader(bank), m_pOut(NULL), m_ExportLimit(CROEXPORT_DEFAULT_LIMIT),
+    m_bWorker(false), m_pBlobStore(NULL)
 {
 }
 
@@ -24,12 +67,39 @@ void CroExport<F>::SetFilePath(const std::wstring& path)
     m_FilePath = path;
 }
 
+template<CroExportFormat F>
+void CroExport<F>::SetBlobStore(CroBlobStore* store)
+{
+    m_pBlobStore = store;
+}
+
 template<CroExportFormat F>
 void CroExport<F>::SetIdentOutput(CroIdent ident, CroSync* out)
 {
     m_Outputs[ident] = out;
 }
 
+template<CroExportFormat F>
+void CroExport<F>::SetExportLimit(cronos_size limit)
+{
+    m_ExportLimit = limit ? limit : CROEXPORT_DEFAULT_LIMIT;
+}
+
+template<CroExportFormat F>
+CroSync* CroExport<F>::GetIdentOutput(CroIdent ident) const
+{
+    auto out = m_Outputs.find(ident);
+    return out != m_Outputs.end() ? out->second : NULL;
+}
+
+template<CroExportFormat F>
+CroBase* CroExport<F>::FindBase(CroIdent ident) const
+{
+    for (auto it = m_pBank->StartBase(); it != m_pBank->EndBase(); it++)
+        if (it->m_BaseIndex == ident) return &*it;
+    return NULL;
+}
+
 template<CroExportFormat F>
 std::string CroExport<F>::StringValue()
 {
@@ -108,41 +178,158 @@ std::string CroExport<F>::StringValue()
     return std::string((const char*)out.GetData(), str.GetPosition());
 }
 
+template<CroExportFormat F>
+std::string CroExport<F>::TextValue()
+{
+    return WcharToText(AnsiToWchar(StringValue(),
+        m_pBank->GetTextCodePage()));
+}
+
+template<CroExportFormat F>
+CroExportValue CroExport<F>::TypedValue()
+{
+    CroExportValue out = { true, 0, "" };
+
+    const uint8_t* value = m_Parser.Value();
+    cronos_size size = m_Parser.ValueSize();
+    CroType type = m_Parser.ValueType();
+
+    char szNum[8] = { 0 };
+    int iYear = 0, iMon = 0, iDay = 0;
+    int iHour = 0, iMin = 0;
+
+    switch (CroColumnType(type))
+    {
+    case CroColumn_Integer:
+        if (type == CroType::Ident)
+        {
+            out.m_Integer = m_Parser.RecordId();
+            out.m_bNull = false;
+            break;
+        }
+
+        // a malformed number is NULL rather than a made up value
+        out.m_bNull = !ParseInteger(value, size, out.m_Integer);
+        if (out.m_bNull) out.m_Integer = 0;
+        break;
+    case CroColumn_Date:
+        if (size < 7) break;
+
+        memcpy(szNum, value, 7);
+        if (sscanf_s(szNum, "%03d%02d%02d", &iYear, &iMon, &iDay) != 3)
+            break;
+        if (iMon < 1 || iMon > 12 || iDay < 1 || iDay > 31)
+            break;
+
+        out.m_Integer = DaysFromCivil(iYear + 1900, iMon, iDay);
+        out.m_bNull = false;
+        break;
+    case CroColumn_Time:
+        if (size < 4) break;
+
+        memcpy(szNum, value, 4);
+        if (sscanf_s(szNum, "%02d%02d", &iHour, &iMin) != 2)
+            break;
+        if (iHour < 0 || iHour > 23 || iMin < 0 || iMin > 59)
+            break;
+
+        out.m_Integer = (iHour * 60 + iMin) * 60000;
+        out.m_bNull = false;
+        break;
+    case CroColumn_Text:
+        out.m_Text = TextValue();
+        out.m_bNull = out.m_Text.empty();
+        break;
+    }
+
+    return out;
+}
+
 template<CroExportFormat F>
 void CroExport<F>::Export(CroRecordMap* map)
 {
     for (cronos_id id = map->IdStart(); id != map->IdEnd(); id++)
     {
         if (!map->HasRecord(id)) continue;
+
+        CroBuffer buffer;
         try {
-            CroBuffer buffer = map->LoadRecord(id);
-            if (buffer.IsEmpty())
-                continue;
-            
-            ReadRecord(id, buffer);
-        }
-        catch (const CroException& ce) {
-            fprintf(stderr, "record %" FCroId ": %s\n",
-                id, ce.what() ? ce.what() : "");
+            buffer = map->LoadRecord(id);
         }
         catch (const std::exception& e) {
             fprintf(stderr, "record %" FCroId ": %s\n",
                 id, e.what() ? e.what() : "");
+            continue;
         }
+
+        ExportRecord(id, buffer);
     }
 }
 
+template<CroExportFormat F>
+void CroExport<F>::ExportRecord(cronos_id id, CroBuffer& record)
+{
+    if (record.IsEmpty()) return;
+
+    try {
+        ReadRecord(id, record);
+    }
+    catch (const CroException& ce) {
+        fprintf(stderr, "record %" FCroId ": %s\n",
+            id, ce.what() ? ce.what() : "");
+        ResetRecord();
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "record %" FCroId ": %s\n",
+            id, e.what() ? e.what() : "");
+        ResetRecord();
+    }
+}
+
+template<CroExportFormat F>
+void CroExport<F>::ExportFinish()
+{
+}
+
 template<CroExportFormat F>
 void CroExport<F>::ExportFile(cronos_id id)
 {
-    CroBuffer fileBuffer = m_pBank->File(CROFILE_BANK)->ReadRecord(id);
+    CroFile* file = m_pBank->File(CROFILE_BANK);
+    CroEntry entry = file->ReadFileEntry(id);
+    if (!entry.IsActive())
+        throw CroException(file, "CroExport::ExportFile not active record");
+
+    if (m_pBlobStore)
+    {
+        m_pBlobStore->Store(file, id, entry);
+        return;
+    }
 
     std::wstring fileName = JoinFilePath(m_FilePath,
         std::to_wstring(id) + L".bin");
-    CroSyncFile fileSync = CroSyncFile(fileName, fileBuffer.GetSize());
+    CroSyncFile fileSync = CroSyncFile(fileName, CROEXPORT_FILE_BUFFER,
+        CROSYNC_TRUNCATE);
+
+    file->StreamRecord(id, file->ReadFileRecord(entry), fileSync);
+    fileSync.Close();
+}
+
+template<CroExportFormat F>
+ICroExport* CroExport<F>::CreateWorker() const
+{
+    return NULL;
+}
 
-    fileSync.Write(fileBuffer.GetData(), fileBuffer.GetSize());
-    fileSync.Flush();
+template<CroExportFormat F>
+bool CroExport<F>::IsResumable() const
+{
+    return false;
+}
+
+template<CroExportFormat F>
+void CroExport<F>::ResumeIdentOutput(CroIdent ident, CroSync* out)
+{
+    m_Outputs[ident] = out;
 }
 
 template<CroExportFormat F>
@@ -178,29 +365,95 @@ void CroExport<F>::OnRecordEnd()
     CroReader::OnRecordEnd();
 }
 
+template<CroExportFormat F>
+void CroExport<F>::ResetRecord()
+{
+    m_pOut = NULL;
+    m_Parser.Reset();
+}
+
 /* CroExportRaw */
 
 CroExportRaw::CroExportRaw(CroBank* bank)
-    : CroExport<CroExportFormat::Raw>(bank)
+    : CroExport<CroExportFormat::Raw>(bank), m_ValueCount(0)
+{
+}
+
+void CroExportRaw::SetIdentOutput(CroIdent ident, CroSync* out)
 {
+    CroExport::SetIdentOutput(ident, out);
+
+    CroBase* base = FindBase(ident);
+    if (out && base && !m_bWorker) WriteSchema(base, out);
+}
+
+ICroExport* CroExportRaw::CreateWorker() const
+{
+    CroExportRaw* worker = new CroExportRaw(m_pBank);
+    worker->m_bWorker = true;
+    return worker;
+}
+
+bool CroExportRaw::IsResumable() const
+{
+    return true;
+}
+
+void CroExportRaw::WriteSchema(CroBase* base, CroSync* out)
+{
+    if (!m_Schemas.insert(out).second) return;
+
+    std::vector<uint8_t> schema;
+    CroRowSchema(schema, base, m_pBank->GetTextCodePage());
+    out->Write(schema.data(), schema.size());
 }
 
 void CroExportRaw::OnRecord()
 {
+    m_Record.clear();
+    m_ValueCount = 0;
+
     CroExport::OnRecord();
 }
 
+void CroExportRaw::OnRecordEnd()
+{
+    CroBase* base = m_Parser.IdentBase();
+    if (m_pOut && base)
+    {
+        m_Header.clear();
+        CroRowVarint(m_Header, m_Parser.RecordId());
+        CroRowVarint(m_Header, base->m_BaseIndex);
+        CroRowVarint(m_Header, m_ValueCount);
+        CroRowVarint(m_Header, m_Record.size());
+
+        m_pOut->Write(m_Header.data(), m_Header.size());
+        m_pOut->Write(m_Record.data(), m_Record.size());
+    }
+
+    m_Record.clear();
+    m_ValueCount = 0;
+    CroExport::OnRecordEnd();
+}
+
 void CroExportRaw::OnValue()
 {
+    CroBase* base = m_Parser.IdentBase();
+    cronos_idx field = base ? (cronos_idx)std::distance(
+        base->StartField(), m_Parser.m_FieldIter) : 0;
+
     CroExport::OnValue();
+    if (!m_pOut) return;
 
-    m_pOut->Write(m_Parser.Value(), m_Parser.ValueSize());
+    CroRowVarint(m_Record, field);
+    CroRowString(m_Record, m_Parser.Value(), m_Parser.ValueSize());
+    m_ValueCount++;
 }
 
 /* CroExportList */
 
 CroExportList::CroExportList(CroBank* bank, cronos_idx burst)
-    : CroExportRaw(bank), m_pRecord(NULL)
+    : CroExport<CroExportFormat::Raw>(bank), m_pRecord(NULL)
 {
     CroFile* file = bank->File(CROFILE_BANK);
     m_Output.InitSync(file->GetDefaultBlockSize() * burst);
@@ -222,7 +475,7 @@ void CroExportList::OnRecord()
     m_pRecord = &m_List[id];
 
     m_pOut = &m_Output;
-    CroExportRaw::OnRecord();
+    CroExport::OnRecord();
 }
 
 void CroExportList::OnValue()
@@ -245,6 +498,18 @@ CroExportCSV::CroExportCSV(CroBank* bank)
 {
 }
 
+ICroExport* CroExportCSV::CreateWorker() const
+{
+    CroExportCSV* worker = new CroExportCSV(m_pBank);
+    worker->m_bWorker = true;
+    return worker;
+}
+
+bool CroExportCSV::IsResumable() const
+{
+    return true;
+}
+
 void CroExportCSV::OnRecord()
 {
     CroExport::OnRecord();
@@ -301,3 +566,132 @@ void CroExportCSV::OnValueNext()
         m_pOut->Write(&csvComma, 1);
     }
 }
+
+/* CroExportTyped */
+
+template<CroExportFormat F>
+CroExportTyped<F>::CroExportTyped(CroBank* bank)
+    : CroExport<F>(bank)
+{
+}
+
+template<CroExportFormat F>
+void CroExportTyped<F>::OnRecord()
+{
+    CroExport<F>::OnRecord();
+
+    CroBase* base = this->m_Parser.IdentBase();
+    m_Row.resize(base->FieldCount());
+    for (auto& value : m_Row)
+    {
+        value.m_bNull = true;
+        value.m_Integer = 0;
+        value.m_Text.clear();
+    }
+}
+
+template<CroExportFormat F>
+void CroExportTyped<F>::OnRecordEnd()
+{
+    CroBase* base = this->m_Parser.IdentBase();
+    if (HasRowOutput() && base)
+        OnRow(base, m_Row);
+
+    CroExport<F>::OnRecordEnd();
+}
+
+template<CroExportFormat F>
+void CroExportTyped<F>::OnValue()
+{
+    CroBankParser& parser = this->m_Parser;
+    cronos_idx index = (cronos_idx)std::distance(
+        parser.IdentBase()->StartField(), parser.m_FieldIter);
+
+    CroExport<F>::OnValue();
+    if (!HasRowOutput() || index >= m_Row.size())
+        return;
+
+    CroExportValue value = this->TypedValue();
+    if (value.m_bNull) return;
+
+    // multi-value fields keep the first number and join text lines
+    CroExportValue& field = m_Row[index];
+    if (field.m_bNull)
+        field = std::move(value);
+    else if (CroColumnType(parser.ValueType()) == CroColumn_Text)
+        field.m_Text += "\n" + value.m_Text;
+}
+
+template<CroExportFormat F>
+bool CroExportTyped<F>::HasRowOutput() const
+{
+    return this->m_pOut != NULL;
+}
+
+/* CroExportColumns */
+
+template<CroExportFormat F>
+CroExportColumns<F>::CroExportColumns(CroBank* bank)
+    : CroExportTyped<F>(bank)
+{
+}
+
+template<CroExportFormat F>
+CroColumnBatch& CroExportColumns<F>::Batch(CroBase* base)
+{
+    auto it = m_Batches.find(base->m_BaseIndex);
+    if (it == m_Batches.end())
+    {
+        it = m_Batches.emplace(base->m_BaseIndex, CroColumnBatch {}).first;
+        it->second.InitBatch(base, this->m_pBank->GetTextCodePage());
+    }
+
+    return it->second;
+}
+
+template<CroExportFormat F>
+void CroExportColumns<F>::OnRow(CroBase* base, CroExportRow& row)
+{
+    CroColumnBatch& batch = Batch(base);
+
+    batch.AppendRow(row);
+    if (batch.ByteSize() >= this->m_ExportLimit)
+    {
+        OnBatch(base, batch, this->m_pOut);
+        batch.Reset();
+    }
+}
+
+template<CroExportFormat F>
+void CroExportColumns<F>::ExportFinish()
+{
+    CroBank* bank = this->m_pBank;
+    for (auto it = bank->StartBase(); it != bank->EndBase(); it++)
+    {
+        CroSync* out = this->GetIdentOutput(it->m_BaseIndex);
+        if (!out) continue;
+
+        CroColumnBatch& batch = Batch(&*it);
+        if (!batch.IsEmpty())
+        {
+            OnBatch(&*it, batch, out);
+            batch.Reset();
+        }
+
+        OnBatchEnd(&*it, batch, out);
+    }
+}
+
+template class CroExport<CroExportFormat::Arrow>;
+template class CroExportTyped<CroExportFormat::Arrow>;
+template class CroExportColumns<CroExportFormat::Arrow>;
+
+template class CroExport<CroExportFormat::Parquet>;
+template class CroExportTyped<CroExportFormat::Parquet>;
+template class CroExportColumns<CroExportFormat::Parquet>;
+
+template class CroExport<CroExportFormat::Postgres>;
+template class CroExportTyped<CroExportFormat::Postgres>;
+
+template class CroExport<CroExportFormat::SQLite>;
+template class CroExportTyped<CroExportFormat::SQLite>;
@@ -3,17 +3,27 @@
 
 #include "croreader.h"
 #include "crobuffer.h"
+#include "crocolumn.h"
 #include <vector>
 #include <map>
+#include <set>
+
+#define CROEXPORT_DEFAULT_LIMIT (16*1024*1024)
+#define CROEXPORT_FILE_BUFFER   (1024*1024)
 
 enum class CroExportFormat {
     File = -1,
     Raw,
     CSV,
-    JSON
+    JSON,
+    Arrow,
+    Parquet,
+    Postgres,
+    SQLite
 };
 
 template<CroExportFormat F> class CroExport;
+class CroBlobStore;
 
 class ICroExport
 {
@@ -21,15 +31,30 @@ public:
     virtual ~ICroExport() {}
 
     virtual void SetFilePath(const std::wstring& path) = 0;
+    virtual void SetBlobStore(CroBlobStore* store) = 0;
     virtual void SetIdentOutput(CroIdent ident, CroSync* out) = 0;
+    virtual void SetExportLimit(cronos_size limit) = 0;
     virtual std::string StringValue() = 0;
 
     virtual CroSync* GetExportOutput() const = 0;
+    virtual CroSync* GetIdentOutput(CroIdent ident) const = 0;
     virtual CroExportFormat GetExportFormat() const = 0;
 
     virtual void Export(CroRecordMap* map) = 0;
+    virtual void ExportRecord(cronos_id id, CroBuffer& record) = 0;
+    virtual void ExportFinish() = 0;
     virtual void ExportFile(cronos_id id) = 0;
 
+    // Exporter for a worker thread that writes the records of a slice to
+    // its own outputs, without headers or trailers. NULL for formats that
+    // keep state across the whole bank.
+    virtual ICroExport* CreateWorker() const = 0;
+
+    // Stream formats can continue an output cut back to a checkpoint,
+    // resuming sets the output without writing its header again.
+    virtual bool IsResumable() const = 0;
+    virtual void ResumeIdentOutput(CroIdent ident, CroSync* out) = 0;
+
     inline CroReader* GetReader()
     {
         return dynamic_cast<CroReader*>(this);
@@ -49,38 +74,70 @@ public:
     virtual ~CroExport();
     
     void SetFilePath(const std::wstring& path) override;
+    void SetBlobStore(CroBlobStore* store) override;
     void SetIdentOutput(CroIdent ident, CroSync* out) override;
+    void SetExportLimit(cronos_size limit) override;
     std::string StringValue() override;
 
+    std::string TextValue();
+    CroExportValue TypedValue();
+
     virtual CroSync* GetExportOutput() const;
+    CroSync* GetIdentOutput(CroIdent ident) const override;
     virtual CroExportFormat GetExportFormat() const;
 
     void Export(CroRecordMap* map) override;
+    void ExportRecord(cronos_id id, CroBuffer& record) override;
+    void ExportFinish() override;
     void ExportFile(cronos_id id) override;
+
+    ICroExport* CreateWorker() const override;
+    bool IsResumable() const override;
+    void ResumeIdentOutput(CroIdent ident, CroSync* out) override;
 protected:
     virtual void OnRecord();
     virtual void OnRecordEnd();
+
+    void ResetRecord();
+    CroBase* FindBase(CroIdent ident) const;
     
     CroSync* m_pOut;
+    cronos_size m_ExportLimit;
+    bool m_bWorker;
 private:
     std::map<CroIdent, CroSync*> m_Outputs;
     std::wstring m_FilePath;
+    CroBlobStore* m_pBlobStore;
     std::vector<cronos_id> m_Files;
 };
 
+// Writes the crorow binary format, see crorow.h. The schema is written
+// as soon as an output is set.
 class CroExportRaw : public CroExport<CroExportFormat::Raw>
 {
 public:
     CroExportRaw(CroBank* bank);
+
+    void SetIdentOutput(CroIdent ident, CroSync* out) override;
+    ICroExport* CreateWorker() const override;
+    bool IsResumable() const override;
 protected:
     virtual void OnRecord();
+    virtual void OnRecordEnd();
     virtual void OnValue();
+private:
+    void WriteSchema(CroBase* base, CroSync* out);
+
+    std::set<CroSync*> m_Schemas;
+    std::vector<uint8_t> m_Record;
+    std::vector<uint8_t> m_Header;
+    cronos_idx m_ValueCount;
 };
 
 using CroExportRecord = std::vector<CroBuffer>;
 using CroExportIter = std::map<cronos_id, CroExportRecord>::iterator;
 
-class CroExportList : public CroExportRaw
+class CroExportList : public CroExport<CroExportFormat::Raw>
 {
 public:
     CroExportList(CroBank* bank, cronos_idx burst);
@@ -103,6 +160,9 @@ class CroExportCSV : public CroExport<CroExportFormat::CSV>
 {
 public:
     CroExportCSV(CroBank* bank);
+
+    ICroExport* CreateWorker() const override;
+    bool IsResumable() const override;
 protected:
     virtual void OnRecord();
     virtual void OnRecordEnd();
@@ -111,4 +171,40 @@ protected:
     virtual void OnValueNext();
 };
 
+template<CroExportFormat F>
+class CroExportTyped : public CroExport<F>
+{
+public:
+    CroExportTyped(CroBank* bank);
+protected:
+    void OnRecord() override;
+    void OnRecordEnd() override;
+    void OnValue() override;
+
+    virtual bool HasRowOutput() const;
+    virtual void OnRow(CroBase* base, CroExportRow& row) = 0;
+
+    CroExportRow m_Row;
+};
+
+template<CroExportFormat F>
+class CroExportColumns : public CroExportTyped<F>
+{
+public:
+    CroExportColumns(CroBank* bank);
+
+    void ExportFinish() override;
+protected:
+    void OnRow(CroBase* base, CroExportRow& row) override;
+
+    virtual void OnBatch(CroBase* base, CroColumnBatch& batch,
+        CroSync* out) = 0;
+    virtual void OnBatchEnd(CroBase* base, CroColumnBatch& batch,
+        CroSync* out) = 0;
+private:
+    CroColumnBatch& Batch(CroBase* base);
+
+    std::map<CroIdent, CroColumnBatch> m_Batches;
+};
+
 #endif
\ No newline at end of file
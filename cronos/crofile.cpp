@@ -4,6 +4,7 @@
 #include "cronos_format.h"
 #include "cronos02.h"
 #include "croexception.h"
+#include "crosync.h"
 #include <win32util.h>
 #include <algorithm>
 #include <stdexcept>
@@ -26,7 +27,10 @@ CroFile::CroFile(const std::wstring& path)
     SetError(CROFILE_OK);
     m_fDat = NULL;
     m_fTad = NULL;
+    m_DatOffset = 0;
+    m_TadOffset = 0;
     m_bEOB = false;
+    m_bCrypt = false;
 }
 
 crofile_status CroFile::Open()
@@ -128,6 +132,13 @@ void CroFile::SetupCrypt(uint32_t secret, uint32_t serial)
 
 void CroFile::LoadCrypt(CroData& key, unsigned keyLen)
 {
+    // every reader of a shared file sets up the same key, only the first
+    // one builds the table others may already be decrypting with
+    std::lock_guard<std::mutex> lock(m_CryptLock);
+    std::vector<uint8_t> id(key.GetData(), key.GetData() + key.GetSize());
+    id.push_back((uint8_t)keyLen);
+    if (m_bCrypt && id == m_CryptKey) return;
+
     if (key.IsEmpty() || ABI()->GetModel() == cronos_model_small)
     {
         Read(m_Crypt, CRONOS_FILE_ID, &cronos02_crypt_table);
@@ -141,6 +152,9 @@ void CroFile::LoadCrypt(CroData& key, unsigned keyLen)
         blowfish_decrypt_buffer(bf.get(), m_Crypt.GetData(),
             m_Crypt.GetSize());
     }
+
+    m_CryptKey = id;
+    m_bCrypt = true;
 }
 
 void CroFile::Decrypt(CroBuffer& block, uint32_t offset, const CroData* crypt)
@@ -221,7 +235,7 @@ bool CroFile::IsFailed() const
 
 bool CroFile::IsEndOfEntries() const
 {
-    return m_bEOB || feof(m_fTad);
+    return m_bEOB;
 }
 
 bool CroFile::IsValidOffset(cronos_off off, cronos_filetype type) const
@@ -256,14 +270,14 @@ cronos_size CroFile::FileSize(cronos_filetype ftype)
 
 cronos_off CroFile::GetOffset(cronos_filetype ftype) const
 {
-    return (cronos_off)_ftelli64(FilePointer(ftype));
+    return ftype == CRONOS_TAD ? m_TadOffset : m_DatOffset;
 }
 
 void CroFile::Seek(cronos_off off, cronos_filetype ftype)
 {
     if (!IsValidOffset(off, ftype))
         throw CroException(this, "CroFile::Seek invalid offset");
-    _fseeki64(FilePointer(ftype), off, SEEK_SET);
+    (ftype == CRONOS_TAD ? m_TadOffset : m_DatOffset) = off;
 }
 
 void CroFile::Read(CroData& data, cronos_id id, cronos_filetype ftype,
@@ -309,19 +323,23 @@ void CroFile::Read(CroData& data, cronos_id id, cronos_filetype ftype,
         data.InitData(this, id, ftype, dataPos, totalSize);
         if (!totalSize) return;
 
-        _fseeki64(fp, dataPos, SEEK_SET);
-        cronos_idx read = (cronos_idx)fread(data.GetData(),
-            dataSize, count, fp);
+        cronos_size got = CroReadAt(fp, data.GetData(),
+            dataSize * count, dataPos);
+        if (got == (cronos_size)-1) throw CroStdError(this);
 
+        cronos_idx read = dataSize ? (cronos_idx)(got / dataSize) : 0;
         if (read < count)
         {
-            if (ferror(fp)) throw CroStdError(this);
-
             if (read) data.Alloc(read * dataSize);
             else throw CroException(this, "CroFile !fread");
         }
 
-        m_bEOB = feof(fp);
+        if (ftype == CRONOS_TAD)
+        {
+            m_TadOffset = dataPos + got;
+            m_bEOB = dataPos + got >= fileSize;
+        }
+        else m_DatOffset = dataPos + got;
     }
     else if (ftype == CRONOS_MEM)
     {
@@ -499,6 +517,11 @@ CroBuffer CroFile::ReadRecord(cronos_id id, const CroFileRecord& rec)
         out.Write(part.GetData(), part.GetSize());
     }
 
+    return DecodeRecord(id, std::move(buffer));
+}
+
+CroBuffer CroFile::DecodeRecord(cronos_id id, CroBuffer buffer)
+{
     if (IsEncrypted())
         Decrypt(buffer, id);
 
@@ -508,6 +531,116 @@ CroBuffer CroFile::ReadRecord(cronos_id id, const CroFileRecord& rec)
     return buffer;
 }
 
+void CroFile::CheckParts(const CroFileRecord& rec)
+{
+    for (auto it = rec.StartPart(); it != rec.EndPart(); it++)
+    {
+        if (it->m_Size && !IsValidOffset(it->m_Pos + it->m_Size - 1,
+            CRONOS_DAT))
+        {
+            throw CroException(this, "CroFile::StreamRecord invalid part");
+        }
+    }
+}
+
+void CroFile::StreamParts(cronos_id id, const CroFileRecord& rec,
+    const std::function<void(CroBuffer&)>& fn)
+{
+    cronos_size recordPos = 0;
+    for (auto it = rec.StartPart(); it != rec.EndPart(); it++)
+    {
+        for (cronos_size done = 0; done < it->m_Size; )
+        {
+            cronos_size size = std::min<cronos_size>(it->m_Size - done,
+                CROFILE_STREAM_CHUNK);
+            CroBuffer piece = Read(id, CRONOS_DAT, it->m_Pos + done, size);
+
+            // the cipher only depends on the position within the record
+            if (IsEncrypted())
+                Decrypt(piece, (uint32_t)(id + recordPos));
+            fn(piece);
+
+            done += size;
+            recordPos += size;
+        }
+    }
+}
+
+bool CroFile::StreamInflate(cronos_id id, const CroFileRecord& rec,
+    const CroStreamCallback& out)
+{
+    z_stream inf = { 0 };
+    if (inflateInit2(&inf, -15) != Z_OK)
+        throw CroException(this, "CroFile::StreamInflate inflateInit2");
+
+    std::vector<uint8_t> window(CROFILE_STREAM_CHUNK);
+    cronos_size skip = 8;
+    int ret = Z_OK;
+
+    try {
+        StreamParts(id, rec, [&](CroBuffer& piece) {
+            cronos_size head = std::min(skip, piece.GetSize());
+            skip -= head;
+            if (ret != Z_OK) return;
+
+            inf.next_in = piece.GetData() + head;
+            inf.avail_in = (uInt)(piece.GetSize() - head);
+            do {
+                inf.next_out = window.data();
+                inf.avail_out = (uInt)window.size();
+
+                ret = inflate(&inf, Z_NO_FLUSH);
+                if (ret == Z_BUF_ERROR) ret = Z_OK;
+                if (ret != Z_OK && ret != Z_STREAM_END) break;
+
+                out(window.data(), window.size() - inf.avail_out);
+            } while (ret == Z_OK && (inf.avail_in || !inf.avail_out));
+        });
+    }
+    catch (...) {
+        inflateEnd(&inf);
+        throw;
+    }
+
+    uLong total = inf.total_out;
+    inflateEnd(&inf);
+
+    // like Decompress, a record that does not inflate at all is kept as is
+    if (ret != Z_OK && ret != Z_STREAM_END && total)
+        throw CroException(this, "CroFile::StreamInflate bad deflate data");
+    return total != 0;
+}
+
+void CroFile::StreamRecord(cronos_id id, const CroFileRecord& rec,
+    const CroStreamCallback& out)
+{
+    CheckParts(rec);
+
+    if (IsCompressed() && StreamInflate(id, rec, out))
+        return;
+
+    StreamParts(id, rec, [&](CroBuffer& piece) {
+        out(piece.GetData(), piece.GetSize());
+    });
+}
+
+void CroFile::StreamRecord(cronos_id id, const CroFileRecord& rec,
+    CroSyncFile& out)
+{
+    if (IsEncrypted() || IsCompressed())
+    {
+        StreamRecord(id, rec, [&](const uint8_t* data, cronos_size size) {
+            out.Write(data, size);
+        });
+        return;
+    }
+
+    CheckParts(rec);
+
+    for (auto it = rec.StartPart(); it != rec.EndPart(); it++)
+        out.CopyFrom(m_fDat, it->m_Pos, it->m_Size);
+}
+
 CroBuffer CroFile::ReadRecord(cronos_id id)
 {
     CroEntry entry = ReadFileEntry(id);
@@ -8,8 +8,17 @@
 #include "crorecord.h"
 #include <memory>
 #include <string>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <mutex>
 
 #define CRONOS_DEFAULT_SERIAL 1
+#define CROFILE_STREAM_CHUNK (1024*1024)
+
+class CroSyncFile;
+
+using CroStreamCallback = std::function<void(const uint8_t*, cronos_size)>;
 
 enum crofile_status {
     CROFILE_OK = 0,
@@ -197,14 +206,36 @@ public:
     CroBuffer ReadRecord(cronos_id id, const CroFileRecord& rec);
     
     CroBuffer ReadRecord(cronos_id id);
+
+    // decrypts and inflates raw record data, touches no file state and
+    // may run on any thread
+    CroBuffer DecodeRecord(cronos_id id, CroBuffer buffer);
+
+    // hands the decoded record to out CROFILE_STREAM_CHUNK wise without
+    // holding it in memory
+    void StreamRecord(cronos_id id, const CroFileRecord& rec,
+        const CroStreamCallback& out);
+    // same into a file, plain banks are copied file to file
+    void StreamRecord(cronos_id id, const CroFileRecord& rec,
+        CroSyncFile& out);
 private:
+    void CheckParts(const CroFileRecord& rec);
+    void StreamParts(cronos_id id, const CroFileRecord& rec,
+        const std::function<void(CroBuffer&)>& fn);
+    bool StreamInflate(cronos_id id, const CroFileRecord& rec,
+        const CroStreamCallback& out);
+
     std::wstring m_Path;
 
     crofile_status m_Status;
     std::string m_Error;
 
+    // reads are positional, the offsets only track the last read for
+    // sequential entry loops, so readers can share one CroFile
     FILE* m_fDat;
     FILE* m_fTad;
+    std::atomic<cronos_off> m_DatOffset;
+    std::atomic<cronos_off> m_TadOffset;
 
     cronos_size m_DatSize;
     cronos_size m_TadSize;
@@ -212,7 +243,7 @@ private:
     cronos_size m_DatTableLimit;
     cronos_size m_TadTableLimit;
 
-    bool m_bEOB;
+    std::atomic<bool> m_bEOB;
 
     CronosABI* m_pABI;
     cronos_version m_Version;
@@ -227,6 +258,9 @@ private:
     CroData m_LiteSecret;
     CroData m_Pad;
     CroData m_Crypt;
+    std::mutex m_CryptLock;
+    std::vector<uint8_t> m_CryptKey;
+    bool m_bCrypt;
 };
 
 #endif
@@ -23,5 +23,15 @@
 #include "crobank.h"
 #include "croreader.h"
 #include "croexport.h"
+#include "crocolumn.h"
+#include "croarrow.h"
+#include "crocodec.h"
+#include "croparquet.h"
+#include "crorow.h"
+#include "cropostgres.h"
+#include "crosqlite.h"
+#include "croparallel.h"
+#include "crodelta.h"
+#include "croblob.h"
 
 #endif
\ No newline at end of file
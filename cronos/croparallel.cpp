@@ -0,0 +1,261 @@
+#include "croparallel.h"
+#include "crodelta.h"
+#include "crofile.h"
+#include <algorithm>
+#include <stdio.h>
+
+/* CroExportParallel */
+
+CroExportParallel::CroExportParallel(ICroExport* exp, CroBank* bank,
+    unsigned threads)
+    : m_pExport(exp), m_pBank(bank), m_Parser(bank), m_bHash(false),
+    m_bStop(false)
+{
+    m_pFile = bank->File(CROFILE_BANK);
+    if (!threads) threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (unsigned i = 0; i < threads; i++)
+    {
+        ICroExport* worker = exp->CreateWorker();
+        if (!worker) break;
+
+        m_Workers.emplace_back(worker);
+    }
+
+    for (auto& worker : m_Workers)
+        m_Threads.emplace_back(&CroExportParallel::Run, this, worker.get());
+}
+
+CroExportParallel::~CroExportParallel()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_bStop = true;
+    }
+
+    m_Cond.notify_all();
+    for (auto& thread : m_Threads)
+        thread.join();
+}
+
+void CroExportParallel::SetRecordCallback(CroRecordCallback callback,
+    bool hash)
+{
+    m_Callback = callback;
+    m_bHash = hash;
+}
+
+void CroExportParallel::SetCheckCallback(CroCheckCallback callback)
+{
+    m_Check = callback;
+}
+
+void CroExportParallel::Run(ICroExport* worker)
+{
+    for (;;)
+    {
+        croparallel_slice* slice;
+        {
+            std::unique_lock<std::mutex> lock(m_Lock);
+            m_Cond.wait(lock, [this] { return m_bStop || !m_Queue.empty(); });
+            if (m_bStop) return;
+
+            slice = m_Queue.front();
+            m_Queue.pop_front();
+        }
+
+        try {
+            ExportSlice(worker, slice);
+        }
+        catch (...) {
+            slice->m_Error = std::current_exception();
+        }
+
+        std::lock_guard<std::mutex> lock(m_Lock);
+        slice->m_bDone = true;
+        m_DoneCond.notify_all();
+    }
+}
+
+bool CroExportParallel::DecodeRecord(CroBankParser& parser, cronos_id id,
+    CroBuffer& raw, CroBuffer& record, croparallel_record& result)
+{
+    try {
+        record = m_pFile->DecodeRecord(id, std::move(raw));
+        if (m_Callback && !record.IsEmpty())
+        {
+            parser.Reset();
+            parser.Parse(id, record);
+            result.m_Base = parser.IdentBase()->m_BaseIndex;
+        }
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "record %" FCroId ": %s\n",
+            id, e.what() ? e.what() : "");
+        return false;
+    }
+
+    return true;
+}
+
+void CroExportParallel::ExportSlice(ICroExport* worker,
+    croparallel_slice* slice)
+{
+    for (CroIdent ident : m_Idents)
+        worker->SetIdentOutput(ident, &slice->m_Outputs[ident]);
+
+    CroBankParser parser(m_pBank);
+    for (size_t i = 0; i < slice->m_Records.size(); i++)
+    {
+        auto& [id, raw] = slice->m_Records[i];
+
+        CroBuffer record;
+        if (DecodeRecord(parser, id, raw, record, slice->m_Results[i]))
+            worker->ExportRecord(id, record);
+    }
+
+    slice->m_Records.clear();
+}
+
+void CroExportParallel::Queue(std::unique_ptr<croparallel_slice> slice)
+{
+    Commit(2 * m_Threads.size() - 1);
+
+    std::lock_guard<std::mutex> lock(m_Lock);
+    m_Queue.push_back(slice.get());
+    m_Slices.push_back(std::move(slice));
+    m_Cond.notify_one();
+}
+
+void CroExportParallel::Commit(size_t inflight)
+{
+    for (;;)
+    {
+        std::unique_ptr<croparallel_slice> slice;
+        {
+            std::unique_lock<std::mutex> lock(m_Lock);
+            if (m_Slices.empty()) return;
+
+            if (!m_Slices.front()->m_bDone)
+            {
+                if (m_Slices.size() <= inflight) return;
+                m_DoneCond.wait(lock,
+                    [this] { return m_Slices.front()->m_bDone; });
+            }
+
+            slice = std::move(m_Slices.front());
+            m_Slices.pop_front();
+        }
+
+        if (slice->m_Error)
+            std::rethrow_exception(slice->m_Error);
+
+        for (auto& [ident, memory] : slice->m_Outputs)
+        {
+            CroSync* out = m_pExport->GetIdentOutput(ident);
+            if (out && memory.MemorySize())
+                out->Write(memory.MemoryData(), memory.MemorySize());
+        }
+
+        if (m_Callback)
+        {
+            for (const auto& result : slice->m_Results)
+                m_Callback(result);
+        }
+    }
+}
+
+void CroExportParallel::Export(CroRecordMap* map,
+    const std::vector<cronos_id>* ids)
+{
+    std::vector<cronos_id> mapIds;
+    if (!ids)
+    {
+        for (cronos_id id = map->IdStart(); id != map->IdEnd(); id++)
+            mapIds.push_back(id);
+        ids = &mapIds;
+    }
+
+    if (IsParallel() && m_Idents.empty())
+    {
+        for (auto it = m_pBank->StartBase(); it != m_pBank->EndBase(); it++)
+            if (m_pExport->GetIdentOutput(it->m_BaseIndex))
+                m_Idents.push_back(it->m_BaseIndex);
+    }
+
+    auto slice = std::make_unique<croparallel_slice>();
+    slice->m_bDone = false;
+    cronos_size sliceSize = 0;
+
+    for (cronos_id id : *ids)
+    {
+        if (!map->HasRecord(id)) continue;
+
+        CroBuffer raw;
+        try {
+            raw = map->ReadRecord(id);
+        }
+        catch (const std::exception& e) {
+            fprintf(stderr, "record %" FCroId ": %s\n",
+                id, e.what() ? e.what() : "");
+            continue;
+        }
+        if (raw.IsEmpty()) continue;
+
+        croparallel_record result = { id, INVALID_CRONOS_IDENT, 0 };
+        if (m_bHash) result.m_Hash = CroDeltaHash(raw.GetData(), raw.GetSize());
+        sliceSize += raw.GetSize();
+
+        if (!IsParallel())
+        {
+            CroBuffer record;
+            if (DecodeRecord(m_Parser, id, raw, record, result))
+                m_pExport->ExportRecord(id, record);
+
+            if (m_Callback) m_Callback(result);
+            if (sliceSize >= CROPARALLEL_SLICE_SIZE)
+            {
+                sliceSize = 0;
+                if (m_Check) m_Check();
+            }
+            continue;
+        }
+
+        slice->m_Records.emplace_back(id, std::move(raw));
+        slice->m_Results.push_back(result);
+
+        if (sliceSize >= CROPARALLEL_SLICE_SIZE)
+        {
+            Queue(std::move(slice));
+
+            slice = std::make_unique<croparallel_slice>();
+            slice->m_bDone = false;
+            sliceSize = 0;
+            if (m_Check) m_Check();
+        }
+    }
+
+    if (!slice->m_Records.empty())
+        Queue(std::move(slice));
+    Commit(2 * m_Threads.size());
+}
+
+void CroExportParallel::Finish()
+{
+    Commit(0);
+}
+
+void CroExportParallel::Reset()
+{
+    std::unique_lock<std::mutex> lock(m_Lock);
+    for (croparallel_slice* slice : m_Queue)
+        slice->m_bDone = true;
+    m_Queue.clear();
+
+    // slices a worker has taken are freed once it is done with them
+    m_DoneCond.wait(lock, [this] {
+        return std::all_of(m_Slices.begin(), m_Slices.end(),
+            [](const auto& slice) { return slice->m_bDone; });
+    });
+    m_Slices.clear();
+}
@@ -0,0 +1,89 @@
+#ifndef __CROPARALLEL_H
+#define __CROPARALLEL_H
+
+#include "croexport.h"
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+#define CROPARALLEL_SLICE_SIZE  (1024*1024)
+
+struct croparallel_record {
+    cronos_id m_Id;
+    CroIdent m_Base;
+    uint64_t m_Hash;
+};
+
+using CroRecordCallback = std::function<void(const croparallel_record&)>;
+using CroCheckCallback = std::function<void()>;
+
+struct croparallel_slice {
+    std::vector<std::pair<cronos_id, CroBuffer>> m_Records;
+    std::vector<croparallel_record> m_Results;
+    std::map<CroIdent, CroSyncMemory> m_Outputs;
+    bool m_bDone;
+    std::exception_ptr m_Error;
+};
+
+// Exports record maps on a pool of threads. The calling thread reads the
+// raw records and cuts them into slices of about CROPARALLEL_SLICE_SIZE.
+// Every worker owns an exporter from ICroExport::CreateWorker, decodes
+// and formats a slice into memory, and the calling thread appends the
+// finished slices to the real outputs strictly in slice order, so each
+// base keeps record id order. At most two slices per worker are in
+// flight. Formats without worker support are exported in place.
+// The record callback reports base and optional raw content hash of every
+// exported record on the calling thread, in record order.
+// The check callback runs on the calling thread after every slice read,
+// an exception thrown from it abandons the rest of the map.
+// After Export threw, Reset drops the slices of the map not written yet.
+class CroExportParallel
+{
+public:
+    CroExportParallel(ICroExport* exp, CroBank* bank, unsigned threads = 0);
+    ~CroExportParallel();
+
+    inline bool IsParallel() const { return !m_Threads.empty(); }
+    void SetRecordCallback(CroRecordCallback callback, bool hash = false);
+    void SetCheckCallback(CroCheckCallback callback);
+
+    // ids, when given, are the ascending subset of the map to export
+    void Export(CroRecordMap* map, const std::vector<cronos_id>* ids = NULL);
+    void Finish();
+    void Reset();
+private:
+    void Run(ICroExport* worker);
+    void ExportSlice(ICroExport* worker, croparallel_slice* slice);
+    bool DecodeRecord(CroBankParser& parser, cronos_id id, CroBuffer& raw,
+        CroBuffer& record, croparallel_record& result);
+    void Queue(std::unique_ptr<croparallel_slice> slice);
+    void Commit(size_t inflight);
+
+    ICroExport* m_pExport;
+    CroBank* m_pBank;
+    CroFile* m_pFile;
+    std::vector<CroIdent> m_Idents;
+
+    CroBankParser m_Parser;
+    CroRecordCallback m_Callback;
+    CroCheckCallback m_Check;
+    bool m_bHash;
+
+    std::mutex m_Lock;
+    std::condition_variable m_Cond;
+    std::condition_variable m_DoneCond;
+    std::deque<croparallel_slice*> m_Queue;
+    std::deque<std::unique_ptr<croparallel_slice>> m_Slices;
+    bool m_bStop;
+
+    std::vector<std::unique_ptr<ICroExport>> m_Workers;
+    std::vector<std::thread> m_Threads;
+};
+
+#endif
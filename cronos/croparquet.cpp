@@ -0,0 +1,611 @@
+#include "croparquet.h"
+#include "crostru.h"
+#include <string.h>
+#include <string_view>
+#include <unordered_map>
+
+#define PARQUET_INT32           1
+#define PARQUET_INT64           2
+#define PARQUET_BYTE_ARRAY      6
+
+#define PARQUET_OPTIONAL        1
+
+#define PARQUET_UTF8            0
+#define PARQUET_DATE            6
+#define PARQUET_TIME_MILLIS     7
+
+#define PARQUET_PLAIN           0
+#define PARQUET_RLE             3
+#define PARQUET_RLE_DICTIONARY  8
+
+#define PARQUET_PAGE_DATA       0
+#define PARQUET_PAGE_DICTIONARY 2
+
+#define THRIFT_TRUE             1
+#define THRIFT_FALSE            2
+#define THRIFT_I32              5
+#define THRIFT_I64              6
+#define THRIFT_BINARY           8
+#define THRIFT_LIST             9
+#define THRIFT_STRUCT           12
+
+static void ParquetVarint(std::vector<uint8_t>& dst, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        dst.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    dst.push_back((uint8_t)value);
+}
+
+template<typename T>
+static void ParquetPut(std::vector<uint8_t>& dst, T value)
+{
+    const uint8_t* data = (const uint8_t*)&value;
+    dst.insert(dst.end(), data, data + sizeof(T));
+}
+
+template<typename T>
+static std::string ParquetStat(T value)
+{
+    return std::string((const char*)&value, sizeof(T));
+}
+
+/* CroThrift */
+
+// Thrift compact protocol, just enough for the Parquet metadata structs
+class CroThrift
+{
+public:
+    CroThrift()
+    {
+        m_LastId.push_back(0);
+    }
+
+    void I32(int16_t id, int32_t value)
+    {
+        Field(id, THRIFT_I32);
+        ParquetVarint(m_Data, ZigZag(value));
+    }
+
+    void I64(int16_t id, int64_t value)
+    {
+        Field(id, THRIFT_I64);
+        ParquetVarint(m_Data, ZigZag(value));
+    }
+
+    void Bool(int16_t id, bool value)
+    {
+        Field(id, value ? THRIFT_TRUE : THRIFT_FALSE);
+    }
+
+    void Binary(int16_t id, const std::string& value)
+    {
+        Field(id, THRIFT_BINARY);
+        ElemBinary(value);
+    }
+
+    void StructBegin(int16_t id)
+    {
+        Field(id, THRIFT_STRUCT);
+        m_LastId.push_back(0);
+    }
+
+    void StructEnd()
+    {
+        m_Data.push_back(0);
+        m_LastId.pop_back();
+    }
+
+    void ListBegin(int16_t id, uint8_t type, unsigned size)
+    {
+        Field(id, THRIFT_LIST);
+        if (size < 15)
+        {
+            m_Data.push_back((uint8_t)((size << 4) | type));
+        }
+        else
+        {
+            m_Data.push_back(0xF0 | type);
+            ParquetVarint(m_Data, size);
+        }
+    }
+
+    void ElemI32(int32_t value)
+    {
+        ParquetVarint(m_Data, ZigZag(value));
+    }
+
+    void ElemBinary(const std::string& value)
+    {
+        ParquetVarint(m_Data, value.size());
+        m_Data.insert(m_Data.end(), value.begin(), value.end());
+    }
+
+    void ElemStructBegin()
+    {
+        m_LastId.push_back(0);
+    }
+
+    const std::vector<uint8_t>& Finish()
+    {
+        m_Data.push_back(0);
+        return m_Data;
+    }
+private:
+    static uint64_t ZigZag(int64_t value)
+    {
+        return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+    }
+
+    void Field(int16_t id, uint8_t type)
+    {
+        int delta = id - m_LastId.back();
+        if (delta > 0 && delta <= 15)
+        {
+            m_Data.push_back((uint8_t)((delta << 4) | type));
+        }
+        else
+        {
+            m_Data.push_back(type);
+            ParquetVarint(m_Data, ZigZag(id));
+        }
+
+        m_LastId.back() = id;
+    }
+
+    std::vector<uint8_t> m_Data;
+    std::vector<int16_t> m_LastId;
+};
+
+/* RLE / bit-packing hybrid */
+
+static void RleBitPack(std::vector<uint8_t>& dst,
+    const std::vector<uint32_t>& values, unsigned bitWidth)
+{
+    uint64_t acc = 0;
+    unsigned bits = 0;
+
+    ParquetVarint(dst, ((values.size() / 8) << 1) | 1);
+    for (uint32_t value : values)
+    {
+        acc |= (uint64_t)value << bits;
+        for (bits += bitWidth; bits >= 8; bits -= 8)
+        {
+            dst.push_back((uint8_t)acc);
+            acc >>= 8;
+        }
+    }
+}
+
+static void RleEncode(const std::vector<uint32_t>& values,
+    unsigned bitWidth, std::vector<uint8_t>& dst)
+{
+    std::vector<uint32_t> literal;
+    size_t pos = 0;
+
+    while (pos < values.size())
+    {
+        size_t end = pos;
+        while (end < values.size() && values[end] == values[pos])
+            end++;
+
+        // bit-packed runs hold groups of 8, so top the literal up from
+        // the run before switching to an RLE run
+        size_t run = end - pos;
+        size_t pad = (8 - literal.size() % 8) % 8;
+        if (run >= pad + 8)
+        {
+            literal.insert(literal.end(), pad, values[pos]);
+            if (!literal.empty())
+            {
+                RleBitPack(dst, literal, bitWidth);
+                literal.clear();
+            }
+
+            ParquetVarint(dst, (uint64_t)(run - pad) << 1);
+            for (unsigned i = 0; i < (bitWidth + 7) / 8; i++)
+                dst.push_back((uint8_t)(values[pos] >> (8 * i)));
+        }
+        else
+        {
+            literal.insert(literal.end(), run, values[pos]);
+        }
+
+        pos = end;
+    }
+
+    if (!literal.empty())
+    {
+        literal.resize((literal.size() + 7) & ~(size_t)7, 0);
+        RleBitPack(dst, literal, bitWidth);
+    }
+}
+
+static int ParquetPhysicalType(crocolumn_type type)
+{
+    switch (type)
+    {
+    case CroColumn_Integer: return PARQUET_INT64;
+    case CroColumn_Date:
+    case CroColumn_Time: return PARQUET_INT32;
+    default: return PARQUET_BYTE_ARRAY;
+    }
+}
+
+static int ParquetConvertedType(crocolumn_type type)
+{
+    switch (type)
+    {
+    case CroColumn_Text: return PARQUET_UTF8;
+    case CroColumn_Date: return PARQUET_DATE;
+    case CroColumn_Time: return PARQUET_TIME_MILLIS;
+    default: return -1;
+    }
+}
+
+static int ParquetCodec(crocodec_type codec)
+{
+    switch (codec)
+    {
+    case CroCodec_Snappy: return 1;
+    case CroCodec_Gzip: return 2;
+    case CroCodec_Zstd: return 6;
+    default: return 0;
+    }
+}
+
+/* CroParquetWriter */
+
+CroParquetWriter::CroParquetWriter(const CroColumnBatch& schema,
+    CroSync* out, crocodec_type codec)
+    : m_pOut(out), m_Codec(codec), m_Offset(0), m_bClosed(false)
+{
+    if (!CroCodecAvailable(m_Codec))
+        m_Codec = CroCodec_Snappy;
+
+    for (unsigned i = 0; i < schema.ColumnCount(); i++)
+    {
+        const CroColumn& column = schema.Column(i);
+        m_Schema.push_back({ column.ColumnName(),
+            column.ColumnType(), false });
+    }
+}
+
+void CroParquetWriter::SetDictionary(unsigned column, bool dict)
+{
+    if (column < m_Schema.size())
+        m_Schema[column].m_bDict = dict;
+}
+
+void CroParquetWriter::WriteData(const void* data, cronos_size size)
+{
+    if (!size) return;
+
+    m_pOut->Write((const uint8_t*)data, size);
+    m_Offset += size;
+}
+
+void CroParquetWriter::WritePage(int pageType, int64_t values,
+    int encoding, const std::vector<uint8_t>& page, croparquet_chunk& chunk)
+{
+    std::vector<uint8_t> packed;
+    const std::vector<uint8_t>* body = &page;
+    if (m_Codec != CroCodec_None)
+    {
+        CroCompress(m_Codec, page.data(), page.size(), packed);
+        body = &packed;
+    }
+
+    CroThrift header;
+    header.I32(1, pageType);
+    header.I32(2, (int32_t)page.size());
+    header.I32(3, (int32_t)body->size());
+    if (pageType == PARQUET_PAGE_DATA)
+    {
+        header.StructBegin(5);
+        header.I32(1, (int32_t)values);
+        header.I32(2, encoding);
+        header.I32(3, PARQUET_RLE);
+        header.I32(4, PARQUET_RLE);
+        header.StructEnd();
+    }
+    else
+    {
+        header.StructBegin(7);
+        header.I32(1, (int32_t)values);
+        header.I32(2, encoding);
+        header.StructEnd();
+    }
+
+    const std::vector<uint8_t>& meta = header.Finish();
+    WriteData(meta.data(), meta.size());
+    WriteData(body->data(), body->size());
+
+    chunk.m_Compressed += meta.size() + body->size();
+    chunk.m_Uncompressed += meta.size() + page.size();
+}
+
+void CroParquetWriter::WriteColumn(const croparquet_column& column,
+    const CroColumn& values, croparquet_chunk& chunk)
+{
+    cronos_idx rows = values.RowCount();
+    int64_t nonNull = rows - values.NullCount();
+
+    chunk = {};
+    chunk.m_Values = rows;
+    chunk.m_NullCount = values.NullCount();
+
+    // definition levels: 1 for a value, 0 for null
+    std::vector<uint32_t> levels(rows);
+    for (cronos_idx row = 0; row < rows; row++)
+        levels[row] = !values.IsNull(row);
+
+    std::vector<uint8_t> encoded;
+    RleEncode(levels, 1, encoded);
+
+    std::vector<uint8_t> page;
+    ParquetPut<int32_t>(page, (int32_t)encoded.size());
+    page.insert(page.end(), encoded.begin(), encoded.end());
+
+    int encoding = PARQUET_PLAIN;
+    CroInteger min = 0, max = 0;
+    if (column.m_Type != CroColumn_Text)
+    {
+        for (cronos_idx row = 0; row < rows; row++)
+        {
+            if (values.IsNull(row)) continue;
+
+            CroInteger value = values.m_Integer[row];
+            if (column.m_Type == CroColumn_Integer)
+                ParquetPut<int64_t>(page, value);
+            else
+                ParquetPut<int32_t>(page, (int32_t)value);
+
+            if (!chunk.m_bStats || value < min) min = value;
+            if (!chunk.m_bStats || value > max) max = value;
+            chunk.m_bStats = true;
+        }
+
+        if (column.m_Type == CroColumn_Integer)
+        {
+            chunk.m_Min = ParquetStat<int64_t>(min);
+            chunk.m_Max = ParquetStat<int64_t>(max);
+        }
+        else
+        {
+            chunk.m_Min = ParquetStat<int32_t>((int32_t)min);
+            chunk.m_Max = ParquetStat<int32_t>((int32_t)max);
+        }
+    }
+    else
+    {
+        auto text = [&values](cronos_idx row) -> std::string_view {
+            return std::string_view(values.m_Text).substr(
+                values.m_Offsets[row],
+                values.m_Offsets[row + 1] - values.m_Offsets[row]);
+        };
+
+        std::unordered_map<std::string_view, uint32_t> dict;
+        std::vector<std::string_view> entries;
+        std::vector<uint32_t> indices;
+        std::string_view minText, maxText;
+
+        for (cronos_idx row = 0; row < rows; row++)
+        {
+            if (values.IsNull(row)) continue;
+            std::string_view value = text(row);
+
+            if (!chunk.m_bStats || value < minText) minText = value;
+            if (!chunk.m_bStats || value > maxText) maxText = value;
+            chunk.m_bStats = true;
+
+            if (!column.m_bDict || entries.size() > CROPARQUET_DICT_MAX)
+                continue;
+
+            auto [it, added] = dict.emplace(value, (uint32_t)entries.size());
+            if (added) entries.push_back(value);
+            indices.push_back(it->second);
+        }
+
+        if (column.m_bDict && entries.size() <= CROPARQUET_DICT_MAX
+            && (int64_t)entries.size() * 2 <= nonNull)
+        {
+            std::vector<uint8_t> dictPage;
+            for (const auto& entry : entries)
+            {
+                ParquetPut<int32_t>(dictPage, (int32_t)entry.size());
+                dictPage.insert(dictPage.end(), entry.begin(), entry.end());
+            }
+
+            chunk.m_Offset = chunk.m_DictOffset = m_Offset;
+            chunk.m_bDict = true;
+            WritePage(PARQUET_PAGE_DICTIONARY, entries.size(),
+                PARQUET_PLAIN, dictPage, chunk);
+
+            unsigned bitWidth = 1;
+            while (bitWidth < 32 && (1ull << bitWidth) < entries.size())
+                bitWidth++;
+
+            encoding = PARQUET_RLE_DICTIONARY;
+            page.push_back((uint8_t)bitWidth);
+            RleEncode(indices, bitWidth, page);
+        }
+        else
+        {
+            for (cronos_idx row = 0; row < rows; row++)
+            {
+                if (values.IsNull(row)) continue;
+                std::string_view value = text(row);
+
+                ParquetPut<int32_t>(page, (int32_t)value.size());
+                page.insert(page.end(), value.begin(), value.end());
+            }
+        }
+
+        // long text would bloat the footer, skip its bounds
+        chunk.m_bStats = chunk.m_bStats
+            && minText.size() <= CROPARQUET_STATS_MAX
+            && maxText.size() <= CROPARQUET_STATS_MAX;
+        chunk.m_Min = minText;
+        chunk.m_Max = maxText;
+    }
+
+    chunk.m_DataOffset = m_Offset;
+    if (!chunk.m_bDict) chunk.m_Offset = m_Offset;
+    WritePage(PARQUET_PAGE_DATA, rows, encoding, page, chunk);
+}
+
+void CroParquetWriter::WriteRowGroup(const CroColumnBatch& batch)
+{
+    if (batch.IsEmpty()) return;
+    if (!m_Offset) WriteData(CROPARQUET_MAGIC, 4);
+
+    croparquet_group& group = m_Groups.emplace_back();
+    group.m_Rows = batch.RowCount();
+    group.m_Chunks.resize(m_Schema.size());
+
+    for (unsigned i = 0; i < m_Schema.size(); i++)
+        WriteColumn(m_Schema[i], batch.Column(i), group.m_Chunks[i]);
+}
+
+void CroParquetWriter::Close()
+{
+    if (m_bClosed) return;
+    if (!m_Offset) WriteData(CROPARQUET_MAGIC, 4);
+
+    CroThrift meta;
+    meta.I32(1, 1);
+
+    meta.ListBegin(2, THRIFT_STRUCT, (unsigned)m_Schema.size() + 1);
+    meta.ElemStructBegin();
+    meta.Binary(4, "schema");
+    meta.I32(5, (int32_t)m_Schema.size());
+    meta.StructEnd();
+    for (const auto& column : m_Schema)
+    {
+        int converted = ParquetConvertedType(column.m_Type);
+
+        meta.ElemStructBegin();
+        meta.I32(1, ParquetPhysicalType(column.m_Type));
+        meta.I32(3, PARQUET_OPTIONAL);
+        meta.Binary(4, column.m_Name);
+        if (converted >= 0) meta.I32(6, converted);
+        meta.StructEnd();
+    }
+
+    int64_t rows = 0;
+    for (const auto& group : m_Groups)
+        rows += group.m_Rows;
+    meta.I64(3, rows);
+
+    meta.ListBegin(4, THRIFT_STRUCT, (unsigned)m_Groups.size());
+    for (const auto& group : m_Groups)
+    {
+        int64_t compressed = 0, uncompressed = 0;
+
+        meta.ElemStructBegin();
+        meta.ListBegin(1, THRIFT_STRUCT, (unsigned)group.m_Chunks.size());
+        for (unsigned i = 0; i < group.m_Chunks.size(); i++)
+        {
+            const croparquet_chunk& chunk = group.m_Chunks[i];
+            const croparquet_column& column = m_Schema[i];
+
+            meta.ElemStructBegin();
+            meta.I64(2, chunk.m_Offset);
+            meta.StructBegin(3);
+            meta.I32(1, ParquetPhysicalType(column.m_Type));
+            meta.ListBegin(2, THRIFT_I32, chunk.m_bDict ? 3 : 2);
+            meta.ElemI32(PARQUET_PLAIN);
+            meta.ElemI32(PARQUET_RLE);
+            if (chunk.m_bDict) meta.ElemI32(PARQUET_RLE_DICTIONARY);
+            meta.ListBegin(3, THRIFT_BINARY, 1);
+            meta.ElemBinary(column.m_Name);
+            meta.I32(4, ParquetCodec(m_Codec));
+            meta.I64(5, chunk.m_Values);
+            meta.I64(6, chunk.m_Uncompressed);
+            meta.I64(7, chunk.m_Compressed);
+            meta.I64(9, chunk.m_DataOffset);
+            if (chunk.m_bDict) meta.I64(11, chunk.m_DictOffset);
+            meta.StructBegin(12);
+            meta.I64(3, chunk.m_NullCount);
+            if (chunk.m_bStats)
+            {
+                meta.Binary(5, chunk.m_Max);
+                meta.Binary(6, chunk.m_Min);
+            }
+            meta.StructEnd();
+            meta.StructEnd();
+            meta.StructEnd();
+
+            compressed += chunk.m_Compressed;
+            uncompressed += chunk.m_Uncompressed;
+        }
+
+        meta.I64(2, uncompressed);
+        meta.I64(3, group.m_Rows);
+        meta.I64(5, group.m_Chunks.front().m_Offset);
+        meta.I64(6, compressed);
+        meta.StructEnd();
+    }
+
+    meta.Binary(6, "cronos");
+
+    meta.ListBegin(7, THRIFT_STRUCT, (unsigned)m_Schema.size());
+    for (unsigned i = 0; i < m_Schema.size(); i++)
+    {
+        meta.ElemStructBegin();
+        meta.StructBegin(1);
+        meta.StructEnd();
+        meta.StructEnd();
+    }
+
+    const std::vector<uint8_t>& footer = meta.Finish();
+    int32_t footerSize = (int32_t)footer.size();
+
+    WriteData(footer.data(), footer.size());
+    WriteData(&footerSize, sizeof(footerSize));
+    WriteData(CROPARQUET_MAGIC, 4);
+
+    m_bClosed = true;
+}
+
+/* CroExportParquet */
+
+CroExportParquet::CroExportParquet(CroBank* bank, crocodec_type codec)
+    : CroExportColumns<CroExportFormat::Parquet>(bank), m_Codec(codec)
+{
+}
+
+CroParquetWriter& CroExportParquet::Writer(CroBase* base,
+    CroColumnBatch& batch, CroSync* out)
+{
+    auto& writer = m_Writers[base->m_BaseIndex];
+    if (!writer)
+    {
+        writer = std::make_unique<CroParquetWriter>(batch, out, m_Codec);
+
+        unsigned column = 0;
+        for (auto it = base->StartField(); it != base->EndField(); it++)
+        {
+            CroType type = it->GetType();
+            writer->SetDictionary(column++,
+                type == CroType::String || type == CroType::VocString);
+        }
+    }
+
+    return *writer;
+}
+
+void CroExportParquet::OnBatch(CroBase* base, CroColumnBatch& batch,
+    CroSync* out)
+{
+    Writer(base, batch, out).WriteRowGroup(batch);
+}
+
+void CroExportParquet::OnBatchEnd(CroBase* base, CroColumnBatch& batch,
+    CroSync* out)
+{
+    Writer(base, batch, out).Close();
+}
@@ -0,0 +1,99 @@
+#ifndef __CROPARQUET_H
+#define __CROPARQUET_H
+
+#include "croexport.h"
+#include "crocolumn.h"
+#include "crocodec.h"
+#include "crosync.h"
+#include <memory>
+#include <vector>
+#include <map>
+
+#define CROPARQUET_MAGIC        "PAR1"
+#define CROPARQUET_DICT_MAX     0xFFFF
+#define CROPARQUET_STATS_MAX    64
+
+#ifdef CRONOS_ZSTD
+#define CROPARQUET_DEFAULT_CODEC CroCodec_Zstd
+#else
+#define CROPARQUET_DEFAULT_CODEC CroCodec_Snappy
+#endif
+
+struct croparquet_chunk {
+    cronos_off m_Offset;
+    cronos_off m_DictOffset;
+    cronos_off m_DataOffset;
+    cronos_size m_Compressed;
+    cronos_size m_Uncompressed;
+
+    int64_t m_Values;
+    int64_t m_NullCount;
+    bool m_bDict;
+
+    bool m_bStats;
+    std::string m_Min;
+    std::string m_Max;
+};
+
+struct croparquet_group {
+    int64_t m_Rows;
+    std::vector<croparquet_chunk> m_Chunks;
+};
+
+struct croparquet_column {
+    std::string m_Name;
+    crocolumn_type m_Type;
+    bool m_bDict;
+};
+
+// Parquet file writer: one row group per column batch, one data page per
+// column chunk, definition levels and dictionary indices RLE encoded.
+// Dictionary encoding is tried for columns marked with SetDictionary and
+// dropped per chunk when the values turn out to be mostly distinct.
+class CroParquetWriter
+{
+public:
+    CroParquetWriter(const CroColumnBatch& schema, CroSync* out,
+        crocodec_type codec = CROPARQUET_DEFAULT_CODEC);
+
+    void SetDictionary(unsigned column, bool dict);
+
+    void WriteRowGroup(const CroColumnBatch& batch);
+    void Close();
+
+    inline bool IsClosed() const { return m_bClosed; }
+private:
+    void WriteData(const void* data, cronos_size size);
+    void WritePage(int pageType, int64_t values, int encoding,
+        const std::vector<uint8_t>& page, croparquet_chunk& chunk);
+    void WriteColumn(const croparquet_column& column,
+        const CroColumn& values, croparquet_chunk& chunk);
+
+    std::vector<croparquet_column> m_Schema;
+    CroSync* m_pOut;
+    crocodec_type m_Codec;
+    cronos_off m_Offset;
+
+    std::vector<croparquet_group> m_Groups;
+    bool m_bClosed;
+};
+
+class CroExportParquet : public CroExportColumns<CroExportFormat::Parquet>
+{
+public:
+    CroExportParquet(CroBank* bank,
+        crocodec_type codec = CROPARQUET_DEFAULT_CODEC);
+protected:
+    void OnBatch(CroBase* base, CroColumnBatch& batch,
+        CroSync* out) override;
+    void OnBatchEnd(CroBase* base, CroColumnBatch& batch,
+        CroSync* out) override;
+private:
+    CroParquetWriter& Writer(CroBase* base, CroColumnBatch& batch,
+        CroSync* out);
+
+    crocodec_type m_Codec;
+    std::map<CroIdent, std::unique_ptr<CroParquetWriter>> m_Writers;
+};
+
+#endif
@@ -0,0 +1,151 @@
+#include "cropostgres.h"
+#include "crocolumn.h"
+#include "crostru.h"
+
+static void PgPut16(std::vector<uint8_t>& dst, int16_t value)
+{
+    dst.push_back((uint8_t)(value >> 8));
+    dst.push_back((uint8_t)value);
+}
+
+static void PgPut32(std::vector<uint8_t>& dst, int32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        dst.push_back((uint8_t)(value >> shift));
+}
+
+static void PgPut64(std::vector<uint8_t>& dst, int64_t value)
+{
+    for (int shift = 56; shift >= 0; shift -= 8)
+        dst.push_back((uint8_t)(value >> shift));
+}
+
+static std::string PgIdentifier(const std::string& name)
+{
+    std::string ident = "\"";
+    for (char c : name)
+    {
+        if (c == '"') ident += '"';
+        ident += c;
+    }
+
+    return ident + "\"";
+}
+
+static const char* PgType(crocolumn_type type)
+{
+    switch (type)
+    {
+    case CroColumn_Integer: return "int8";
+    case CroColumn_Date: return "date";
+    case CroColumn_Time: return "time";
+    default: return "text";
+    }
+}
+
+/* CroExportPostgres */
+
+CroExportPostgres::CroExportPostgres(CroBank* bank)
+    : CroExportTyped<CroExportFormat::Postgres>(bank)
+{
+}
+
+std::string CroExportPostgres::CreateTable(CroBase* base, unsigned codepage)
+{
+    std::vector<std::string> columns = CroColumnNames(base, codepage);
+    std::string sql = "CREATE TABLE "
+        + PgIdentifier(CroTableName(base, codepage)) + " (\n";
+
+    unsigned idx = 0;
+    for (auto it = base->StartField(); it != base->EndField(); it++, idx++)
+    {
+        sql += "    " + PgIdentifier(columns[idx]) + " "
+            + PgType(CroColumnType(it->GetType()));
+        sql += idx + 1 < columns.size() ? ",\n" : "\n";
+    }
+
+    return sql + ");\n";
+}
+
+void CroExportPostgres::WriteHeader(CroSync* out)
+{
+    if (!m_Headers.insert(out).second) return;
+
+    std::vector<uint8_t> header(CROPOSTGRES_SIGNATURE,
+        CROPOSTGRES_SIGNATURE + 11);
+    PgPut32(header, 0);
+    PgPut32(header, 0);
+
+    out->Write(header.data(), header.size());
+}
+
+void CroExportPostgres::SetIdentOutput(CroIdent ident, CroSync* out)
+{
+    CroExportTyped<CroExportFormat::Postgres>::SetIdentOutput(ident, out);
+    if (out && !m_bWorker) WriteHeader(out);
+}
+
+ICroExport* CroExportPostgres::CreateWorker() const
+{
+    CroExportPostgres* worker = new CroExportPostgres(m_pBank);
+    worker->m_bWorker = true;
+    return worker;
+}
+
+bool CroExportPostgres::IsResumable() const
+{
+    return true;
+}
+
+void CroExportPostgres::ExportFinish()
+{
+    std::vector<uint8_t> trailer;
+    PgPut16(trailer, -1);
+
+    for (auto it = m_pBank->StartBase(); it != m_pBank->EndBase(); it++)
+    {
+        CroSync* out = GetIdentOutput(it->m_BaseIndex);
+        if (out) out->Write(trailer.data(), trailer.size());
+    }
+}
+
+void CroExportPostgres::OnRow(CroBase* base, CroExportRow& row)
+{
+    m_Tuple.clear();
+    PgPut16(m_Tuple, (int16_t)row.size());
+
+    unsigned idx = 0;
+    for (auto it = base->StartField(); it != base->EndField(); it++, idx++)
+    {
+        const CroExportValue& value = row[idx];
+        if (value.m_bNull)
+        {
+            PgPut32(m_Tuple, -1);
+            continue;
+        }
+
+        switch (CroColumnType(it->GetType()))
+        {
+        case CroColumn_Integer:
+            PgPut32(m_Tuple, 8);
+            PgPut64(m_Tuple, value.m_Integer);
+            break;
+        case CroColumn_Date:
+            PgPut32(m_Tuple, 4);
+            PgPut32(m_Tuple, (int32_t)(value.m_Integer
+                - CROPOSTGRES_EPOCH_DAYS));
+            break;
+        case CroColumn_Time:
+            PgPut32(m_Tuple, 8);
+            PgPut64(m_Tuple, value.m_Integer * 1000);
+            break;
+        case CroColumn_Text:
+            PgPut32(m_Tuple, (int32_t)value.m_Text.size());
+            m_Tuple.insert(m_Tuple.end(),
+                value.m_Text.begin(), value.m_Text.end());
+            break;
+        }
+    }
+
+    m_pOut->Write(m_Tuple.data(), m_Tuple.size());
+}
@@ -0,0 +1,36 @@
+#ifndef __CROPOSTGRES_H
+#define __CROPOSTGRES_H
+
+#include "croexport.h"
+#include <string>
+#include <vector>
+#include <set>
+
+#define CROPOSTGRES_SIGNATURE   "PGCOPY\n\377\r\n"
+#define CROPOSTGRES_EPOCH_DAYS  10957
+
+// PostgreSQL binary COPY stream per base: int8 for Ident/Integer, text,
+// date and time. Load with COPY table FROM 'file' WITH (FORMAT binary).
+// The header is written when the output is set, the trailer on finish.
+// A resumed output continues after the last checkpointed tuple.
+class CroExportPostgres : public CroExportTyped<CroExportFormat::Postgres>
+{
+public:
+    CroExportPostgres(CroBank* bank);
+
+    static std::string CreateTable(CroBase* base, unsigned codepage);
+
+    void SetIdentOutput(CroIdent ident, CroSync* out) override;
+    void ExportFinish() override;
+    ICroExport* CreateWorker() const override;
+    bool IsResumable() const override;
+protected:
+    void OnRow(CroBase* base, CroExportRow& row) override;
+private:
+    void WriteHeader(CroSync* out);
+
+    std::set<CroSync*> m_Headers;
+    std::vector<uint8_t> m_Tuple;
+};
+
+#endif
@@ -91,7 +91,7 @@ void CroRecordMap::Load()
     }
 }
 
-CroBuffer CroRecordMap::LoadRecord(cronos_id id)
+CroBuffer CroRecordMap::ReadRecord(cronos_id id)
 {
     auto file = File();
     auto& rec = m_Record[id];
@@ -106,15 +106,14 @@ CroBuffer CroRecordMap::LoadRecord(cronos_id id)
         out.Write(part.GetData(), part.GetSize());
     }
 
-    if (file->IsEncrypted())
-        file->Decrypt(buffer, id);
-
-    if (file->IsCompressed())
-        return file->Decompress(buffer);
-
     return buffer;
 }
 
+CroBuffer CroRecordMap::LoadRecord(cronos_id id)
+{
+    return File()->DecodeRecord(id, ReadRecord(id));
+}
+
 bool CroRecordMap::HasRecord(cronos_id id) const
 {
     if (!GetEntry(id).IsActive())
@@ -30,6 +30,7 @@ public:
     inline const auto& PartMap() const { return m_Record; }
 
     void Load();
+    CroBuffer ReadRecord(cronos_id id);
     CroBuffer LoadRecord(cronos_id id);
     bool HasRecord(cronos_id id) const;
 private:
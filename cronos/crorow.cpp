@@ -0,0 +1,150 @@
+#include "crorow.h"
+#include "crostru.h"
+#include <stdexcept>
+#include <string.h>
+
+static inline uint64_t RowVarint(const uint8_t*& cur, const uint8_t* end)
+{
+    if (cur < end && *cur < 0x80)
+        return *cur++;
+
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        if (cur >= end)
+            throw std::runtime_error("crorow truncated varint");
+
+        uint8_t byte = *cur++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+
+    throw std::runtime_error("crorow bad varint");
+}
+
+void CroRowVarint(std::vector<uint8_t>& dst, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        dst.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    dst.push_back((uint8_t)value);
+}
+
+uint64_t CroRowReadVarint(const uint8_t*& cur, const uint8_t* end)
+{
+    return RowVarint(cur, end);
+}
+
+void CroRowString(std::vector<uint8_t>& dst, const void* str,
+    cronos_size size)
+{
+    const uint8_t* data = (const uint8_t*)str;
+
+    CroRowVarint(dst, size);
+    dst.insert(dst.end(), data, data + size);
+}
+
+void CroRowSchema(std::vector<uint8_t>& dst, CroBase* base,
+    unsigned codepage)
+{
+    dst.insert(dst.end(), CROROW_MAGIC, CROROW_MAGIC + 6);
+    dst.push_back(CROROW_VERSION);
+    dst.push_back(0);
+
+    CroRowVarint(dst, codepage);
+    CroRowVarint(dst, base->m_BaseIndex);
+    CroRowString(dst, base->m_Name.data(), base->m_Name.size());
+    CroRowString(dst, base->m_Mnemocode.data(), base->m_Mnemocode.size());
+
+    CroRowVarint(dst, base->FieldCount());
+    for (auto it = base->StartField(); it != base->EndField(); it++)
+    {
+        CroRowString(dst, it->m_Name.data(), it->m_Name.size());
+        CroRowVarint(dst, (unsigned)it->m_Type);
+        CroRowVarint(dst, it->m_Flags);
+        CroRowVarint(dst, it->m_DataIndex);
+        CroRowVarint(dst, it->m_DataLength);
+    }
+}
+
+/* CroRowRecord */
+
+CroRowRecord::CroRowRecord()
+    : m_Id(INVALID_CRONOS_ID), m_Base(0), m_Count(0), m_Size(0),
+    m_pCur(NULL), m_pEnd(NULL)
+{
+}
+
+bool CroRowRecord::NextValue(crorow_value& value)
+{
+    if (m_pCur >= m_pEnd) return false;
+
+    value.m_Field = (cronos_idx)RowVarint(m_pCur, m_pEnd);
+    value.m_Size = RowVarint(m_pCur, m_pEnd);
+    if (value.m_Size > (cronos_size)(m_pEnd - m_pCur))
+        throw std::runtime_error("crorow truncated value");
+
+    value.m_pData = m_pCur;
+    m_pCur += value.m_Size;
+    return true;
+}
+
+/* CroRowReader */
+
+CroRowReader::CroRowReader(const uint8_t* data, cronos_size size)
+    : m_pData(data), m_pCur(data), m_pEnd(data + size)
+{
+    if (size < 8 || memcmp(data, CROROW_MAGIC, 6))
+        throw std::runtime_error("not a crorow file");
+
+    m_Schema.m_Version = data[6];
+    if (m_Schema.m_Version > CROROW_VERSION)
+        throw std::runtime_error("unsupported crorow version");
+    m_pCur += 8;
+
+    m_Schema.m_CodePage = (unsigned)RowVarint(m_pCur, m_pEnd);
+    m_Schema.m_BaseIndex = (CroIdent)RowVarint(m_pCur, m_pEnd);
+    m_Schema.m_Name = ReadString();
+    m_Schema.m_Mnemocode = ReadString();
+
+    uint64_t fieldCount = RowVarint(m_pCur, m_pEnd);
+    for (uint64_t i = 0; i < fieldCount; i++)
+    {
+        crorow_field& field = m_Schema.m_Fields.emplace_back();
+        field.m_Name = ReadString();
+        field.m_Type = (CroType)RowVarint(m_pCur, m_pEnd);
+        field.m_Flags = (uint32_t)RowVarint(m_pCur, m_pEnd);
+        field.m_Index = (uint32_t)RowVarint(m_pCur, m_pEnd);
+        field.m_Length = (uint32_t)RowVarint(m_pCur, m_pEnd);
+    }
+}
+
+std::string CroRowReader::ReadString()
+{
+    uint64_t size = RowVarint(m_pCur, m_pEnd);
+    if (size > (uint64_t)(m_pEnd - m_pCur))
+        throw std::runtime_error("crorow truncated string");
+
+    std::string str((const char*)m_pCur, size);
+    m_pCur += size;
+    return str;
+}
+
+bool CroRowReader::NextRecord(CroRowRecord& record)
+{
+    if (m_pCur >= m_pEnd) return false;
+
+    record.m_Id = (cronos_id)RowVarint(m_pCur, m_pEnd);
+    record.m_Base = (CroIdent)RowVarint(m_pCur, m_pEnd);
+    record.m_Count = (cronos_idx)RowVarint(m_pCur, m_pEnd);
+    record.m_Size = RowVarint(m_pCur, m_pEnd);
+    if (record.m_Size > (cronos_size)(m_pEnd - m_pCur))
+        throw std::runtime_error("crorow truncated record");
+
+    record.m_pCur = m_pCur;
+    record.m_pEnd = m_pCur + record.m_Size;
+    m_pCur = record.m_pEnd;
+    return true;
+}
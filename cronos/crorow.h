@@ -0,0 +1,90 @@
+#ifndef __CROROW_H
+#define __CROROW_H
+
+#include "crotype.h"
+#include <string>
+#include <vector>
+
+#define CROROW_MAGIC            "CROROW"
+#define CROROW_VERSION          1
+
+// Binary row format, every integer is an unsigned LEB128 varint:
+//   schema: "CROROW" version 0, codepage, base index, name, mnemocode,
+//           field count and { name, type, flags, index, length } per field
+//   record: id, base index, value count, value bytes,
+//           then { field, length, data } per value
+// Strings are a varint length followed by the bytes. Values keep the raw
+// bank encoding, multi-values repeat the same field index.
+
+class CroBase;
+
+struct crorow_field {
+    std::string m_Name;
+    CroType m_Type;
+    uint32_t m_Flags;
+    uint32_t m_Index;
+    uint32_t m_Length;
+};
+
+struct crorow_schema {
+    unsigned m_Version;
+    unsigned m_CodePage;
+    CroIdent m_BaseIndex;
+    std::string m_Name;
+    std::string m_Mnemocode;
+    std::vector<crorow_field> m_Fields;
+};
+
+struct crorow_value {
+    cronos_idx m_Field;
+    const uint8_t* m_pData;
+    cronos_size m_Size;
+};
+
+void CroRowVarint(std::vector<uint8_t>& dst, uint64_t value);
+uint64_t CroRowReadVarint(const uint8_t*& cur, const uint8_t* end);
+void CroRowString(std::vector<uint8_t>& dst, const void* str,
+    cronos_size size);
+void CroRowSchema(std::vector<uint8_t>& dst, CroBase* base,
+    unsigned codepage);
+
+// Record view into the reader's buffer, values point into it as well
+class CroRowRecord
+{
+public:
+    CroRowRecord();
+
+    bool NextValue(crorow_value& value);
+
+    cronos_id m_Id;
+    CroIdent m_Base;
+    cronos_idx m_Count;
+    cronos_size m_Size;
+private:
+    friend class CroRowReader;
+
+    const uint8_t* m_pCur;
+    const uint8_t* m_pEnd;
+};
+
+// Zero-copy reader over a complete row file mapped or loaded in memory
+class CroRowReader
+{
+public:
+    CroRowReader(const uint8_t* data, cronos_size size);
+
+    inline const crorow_schema& Schema() const { return m_Schema; }
+    inline cronos_size Position() const { return m_pCur - m_pData; }
+
+    bool NextRecord(CroRowRecord& record);
+private:
+    std::string ReadString();
+
+    const uint8_t* m_pData;
+    const uint8_t* m_pCur;
+    const uint8_t* m_pEnd;
+
+    crorow_schema m_Schema;
+};
+
+#endif
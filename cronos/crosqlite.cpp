@@ -0,0 +1,251 @@
+#include "crosqlite.h"
+#include "crostru.h"
+#include <win32util.h>
+#include <sqlite3.h>
+#include <stdexcept>
+#include <set>
+
+static std::string SqlIdentifier(const std::string& name)
+{
+    std::string ident = "\"";
+    for (char c : name)
+    {
+        if (c == '"') ident += '"';
+        ident += c;
+    }
+
+    return ident + "\"";
+}
+
+static const char* SqlType(crocolumn_type type)
+{
+    switch (type)
+    {
+    case CroColumn_Integer: return "INTEGER";
+    case CroColumn_Date: return "DATE";
+    case CroColumn_Time: return "TIME";
+    default: return "TEXT";
+    }
+}
+
+static std::string SqlDate(CroInteger days)
+{
+    days += 719468;
+    const CroInteger era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = (unsigned)(days - era * 146097);
+    const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned mp = (5 * doy + 2) / 153;
+    const unsigned day = doy - (153 * mp + 2) / 5 + 1;
+    const unsigned mon = mp < 10 ? mp + 3 : mp - 9;
+    const CroInteger year = (CroInteger)yoe + era * 400 + (mon <= 2);
+
+    char szDate[32];
+    sprintf_s(szDate, "%04lld-%02u-%02u", (long long)year, mon, day);
+    return szDate;
+}
+
+static std::string SqlTime(CroInteger ms)
+{
+    char szTime[16];
+    unsigned sec = (unsigned)(ms / 1000);
+
+    sprintf_s(szTime, "%02u:%02u:%02u", sec / 3600, sec / 60 % 60, sec % 60);
+    return szTime;
+}
+
+/* CroExportSQLite */
+
+CroExportSQLite::CroExportSQLite(CroBank* bank, const std::wstring& path)
+    : CroExportTyped<CroExportFormat::SQLite>(bank), m_DatabasePath(path),
+    m_pDatabase(NULL), m_pTable(NULL), m_TransactionRows(0)
+{
+}
+
+CroExportSQLite::~CroExportSQLite()
+{
+    CloseDatabase();
+}
+
+void CroExportSQLite::Execute(const std::string& sql)
+{
+    char* error = NULL;
+    if (sqlite3_exec(m_pDatabase, sql.c_str(), NULL, NULL, &error)
+        != SQLITE_OK)
+    {
+        std::string what = error ? error : "sqlite3_exec failed";
+        sqlite3_free(error);
+
+        throw std::runtime_error(what);
+    }
+}
+
+void CroExportSQLite::OpenDatabase()
+{
+    if (m_pDatabase) return;
+
+    if (sqlite3_open_v2(WcharToText(m_DatabasePath).c_str(), &m_pDatabase,
+        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK)
+    {
+        std::string what = sqlite3_errmsg(m_pDatabase);
+        CloseDatabase();
+
+        throw std::runtime_error(what);
+    }
+
+    // bulk load: no rollback journal, no fsync, page cache sized like
+    // the export buffers
+    Execute("PRAGMA journal_mode=OFF");
+    Execute("PRAGMA synchronous=OFF");
+    Execute("PRAGMA locking_mode=EXCLUSIVE");
+    Execute("PRAGMA temp_store=MEMORY");
+    Execute("PRAGMA cache_size=-" + std::to_string(m_ExportLimit / 1024));
+
+    for (auto it = m_pBank->StartBase(); it != m_pBank->EndBase(); it++)
+        CreateTable(&*it);
+
+    Execute("BEGIN");
+    m_TransactionRows = 0;
+}
+
+void CroExportSQLite::CloseDatabase()
+{
+    for (auto& [index, table] : m_Tables)
+    {
+        sqlite3_finalize(table.m_pInsert);
+        table.m_pInsert = NULL;
+    }
+
+    m_Tables.clear();
+    m_pTable = NULL;
+
+    sqlite3_close(m_pDatabase);
+    m_pDatabase = NULL;
+}
+
+void CroExportSQLite::CreateTable(CroBase* base)
+{
+    unsigned codepage = m_pBank->GetTextCodePage();
+    std::string name = CroTableName(base, codepage);
+
+    std::set<std::string> used;
+    for (const auto& [index, table] : m_Tables)
+        used.insert(table.m_Name);
+    if (used.count(name))
+        name += "_" + std::to_string(base->m_BaseIndex);
+
+    crosqlite_table& table = m_Tables[base->m_BaseIndex];
+    table.m_Name = name;
+    table.m_Columns = CroColumnNames(base, codepage);
+    table.m_pInsert = NULL;
+
+    std::string sql = "CREATE TABLE " + SqlIdentifier(name) + " (";
+    std::string insert = "INSERT INTO " + SqlIdentifier(name) + " VALUES (";
+
+    unsigned idx = 0;
+    for (auto it = base->StartField(); it != base->EndField(); it++, idx++)
+    {
+        crocolumn_type type = CroColumnType(it->GetType());
+        table.m_Types.push_back(type);
+        if (it->GetType() == CroType::Ident)
+            table.m_Indexes.push_back(idx);
+
+        sql += (idx ? ", " : "") + SqlIdentifier(table.m_Columns[idx])
+            + " " + SqlType(type);
+        insert += idx ? ", ?" : "?";
+    }
+
+    Execute(sql + ")");
+    if (table.m_Columns.empty()) return;
+
+    if (sqlite3_prepare_v2(m_pDatabase, (insert + ")").c_str(), -1,
+        &table.m_pInsert, NULL) != SQLITE_OK)
+    {
+        throw std::runtime_error(sqlite3_errmsg(m_pDatabase));
+    }
+}
+
+void CroExportSQLite::ExportFinish()
+{
+    OpenDatabase();
+    Execute("COMMIT");
+
+    for (const auto& [index, table] : m_Tables)
+    {
+        for (unsigned column : table.m_Indexes)
+        {
+            std::string name = table.m_Name + "_" + table.m_Columns[column];
+            Execute("CREATE INDEX " + SqlIdentifier(name) + " ON "
+                + SqlIdentifier(table.m_Name) + " ("
+                + SqlIdentifier(table.m_Columns[column]) + ")");
+        }
+    }
+
+    CloseDatabase();
+}
+
+void CroExportSQLite::OnRecord()
+{
+    CroExportTyped<CroExportFormat::SQLite>::OnRecord();
+    OpenDatabase();
+
+    auto it = m_Tables.find(m_Parser.IdentBase()->m_BaseIndex);
+    m_pTable = it != m_Tables.end() && it->second.m_pInsert
+        ? &it->second : NULL;
+}
+
+bool CroExportSQLite::HasRowOutput() const
+{
+    return m_pTable != NULL;
+}
+
+void CroExportSQLite::OnRow(CroBase* base, CroExportRow& row)
+{
+    sqlite3_stmt* insert = m_pTable->m_pInsert;
+    std::string text;
+
+    for (unsigned i = 0; i < row.size(); i++)
+    {
+        const CroExportValue& value = row[i];
+        int col = i + 1;
+
+        if (value.m_bNull)
+        {
+            sqlite3_bind_null(insert, col);
+            continue;
+        }
+
+        switch (m_pTable->m_Types[i])
+        {
+        case CroColumn_Integer:
+            sqlite3_bind_int64(insert, col, value.m_Integer);
+            break;
+        case CroColumn_Date:
+            text = SqlDate(value.m_Integer);
+            sqlite3_bind_text(insert, col, text.c_str(), (int)text.size(),
+                SQLITE_TRANSIENT);
+            break;
+        case CroColumn_Time:
+            text = SqlTime(value.m_Integer);
+            sqlite3_bind_text(insert, col, text.c_str(), (int)text.size(),
+                SQLITE_TRANSIENT);
+            break;
+        case CroColumn_Text:
+            sqlite3_bind_text(insert, col, value.m_Text.c_str(),
+                (int)value.m_Text.size(), SQLITE_STATIC);
+            break;
+        }
+    }
+
+    int ret = sqlite3_step(insert);
+    sqlite3_reset(insert);
+    if (ret != SQLITE_DONE)
+        throw std::runtime_error(sqlite3_errmsg(m_pDatabase));
+
+    if (++m_TransactionRows >= CROSQLITE_TRANSACTION)
+    {
+        Execute("COMMIT");
+        Execute("BEGIN");
+        m_TransactionRows = 0;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef __CROSQLITE_H
+#define __CROSQLITE_H
+
+#include "croexport.h"
+#include "crocolumn.h"
+#include <string>
+#include <vector>
+#include <map>
+
+#define CROSQLITE_BANK_FILE     L"bank.sqlite"
+#define CROSQLITE_TRANSACTION   100000
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+struct crosqlite_table {
+    std::string m_Name;
+    std::vector<std::string> m_Columns;
+    std::vector<crocolumn_type> m_Types;
+    std::vector<unsigned> m_Indexes;
+    sqlite3_stmt* m_pInsert;
+};
+
+// One SQLite database per bank with a table per base. The database is
+// opened on first use with journaling and syncing off, rows go through
+// prepared inserts in large transactions and indexes are built at the end.
+// Only functional when built with CRONOS_SQLITE.
+class CroExportSQLite : public CroExportTyped<CroExportFormat::SQLite>
+{
+public:
+    CroExportSQLite(CroBank* bank, const std::wstring& path);
+    virtual ~CroExportSQLite();
+
+    void ExportFinish() override;
+protected:
+    void OnRecord() override;
+    bool HasRowOutput() const override;
+    void OnRow(CroBase* base, CroExportRow& row) override;
+private:
+    void OpenDatabase();
+    void CloseDatabase();
+    void Execute(const std::string& sql);
+    void CreateTable(CroBase* base);
+
+    std::wstring m_DatabasePath;
+    sqlite3* m_pDatabase;
+
+    std::map<CroIdent, crosqlite_table> m_Tables;
+    crosqlite_table* m_pTable;
+    cronos_idx m_TransactionRows;
+};
+
+#endif
@@ -196,56 +196,102 @@ void CroPropNS::Parse(CroParser* parser, CroStream& stream)
 
 CroStruParser::CroStruParser(CroBank* bank, CroRecordMap* stru)
     : CroParser(bank, CROFILE_STRU),
-    m_pStru(stru)
+    m_pStru(stru), m_bIndexed(false)
 {
 }
 
-croblock_type CroStruParser::GetBlockType(cronos_id blockId)
+void CroStruParser::IndexBlocks()
+{
+    if (m_bIndexed) return;
+
+    std::unordered_map<cronos_id, crostru_block> blocks;
+    std::unordered_map<std::string, cronos_id> attrs;
+    for (cronos_id id = m_pStru->IdStart(); id != m_pStru->IdEnd(); id++)
+    {
+        if (!m_pStru->HasRecord(id)) continue;
+
+        CroBuffer raw = m_pStru->ReadRecord(id);
+        if (raw.IsEmpty()) continue;
+
+        // the type is the first byte decrypted, before any inflate
+        CroBuffer type;
+        type.Write(raw.GetData(), 1);
+        File()->Decrypt(type, id);
+
+        crostru_block block;
+        block.m_Type = (croblock_type)type.GetData()[0];
+        block.m_bDecoded = false;
+        block.m_Record = std::move(raw);
+        block.m_AttrStart = 0;
+
+        if (block.m_Type == CROBLOCK_ATTR)
+        {
+            // a block that does not decode stays unnamed, and raw until
+            // something references it
+            try {
+                block.m_Record = File()->DecodeRecord(id, block.m_Record);
+                block.m_bDecoded = true;
+
+                CroStream stream = CroStream(block.m_Record);
+                stream.Read<uint8_t>();
+                block.m_AttrStart = stream.GetPosition();
+
+                CroAttr attr = Parse<CroAttr>(stream);
+                attrs.emplace(attr.AttrName(), id);
+            }
+            catch (const std::exception&) {
+            }
+        }
+
+        blocks.emplace(id, std::move(block));
+    }
+
+    m_Blocks = std::move(blocks);
+    m_Attrs = std::move(attrs);
+    m_bIndexed = true;
+}
+
+crostru_block& CroStruParser::GetBlock(cronos_id blockId)
 {
-    if (!m_pStru->HasRecord(blockId))
+    IndexBlocks();
+
+    auto it = m_Blocks.find(blockId);
+    if (it == m_Blocks.end())
     {
         throw std::runtime_error("invalid block");
     }
 
-    auto& map = m_pStru->PartMap();
-    auto& record = map[blockId];
-    
-    auto& part = record.RecordParts().front();
-    CroData block = File()->Read(blockId, CRONOS_DAT,
-        part.m_PartOff, part.m_PartSize);
-    File()->Decrypt(block, blockId);
+    crostru_block& block = it->second;
+    if (!block.m_bDecoded)
+    {
+        // decode a copy, a failed block stays raw and throws again
+        block.m_Record = File()->DecodeRecord(blockId, block.m_Record);
+        block.m_bDecoded = true;
+    }
 
-    return (croblock_type)block.Get<uint8_t>(0x00);
+    return block;
+}
+
+croblock_type CroStruParser::GetBlockType(cronos_id blockId)
+{
+    return GetBlock(blockId).m_Type;
 }
 
 bool CroStruParser::GetAttrByName(const std::string& name,
     CroBuffer& record, CroStream& stream)
 {
-    for (cronos_id id = m_pStru->IdStart(); id != m_pStru->IdEnd(); id++)
-    {
-        if (!m_pStru->HasRecord(id)) continue;
-        
-        if (GetBlockType(id) == CROBLOCK_ATTR)
-        {
-            CroBuffer _record = m_pStru->LoadRecord(id);
-            CroStream _stream = CroStream(_record);
+    IndexBlocks();
 
-            _stream.Read<uint8_t>();
-            cronos_off attrStart = _stream.GetPosition();
+    auto it = m_Attrs.find(name);
+    if (it == m_Attrs.end())
+        return false;
 
-            CroAttr attr = Parse<CroAttr>(_stream);
-            if (attr.AttrName() == name)
-            {
-                record.Copy(_record.GetData(), _record.GetSize());
-                stream = CroStream(record);
-                
-                stream.SetPosition(attrStart);
-                return true;
-            }
-        }
-    }
+    const crostru_block& block = GetBlock(it->second);
+    record.Copy(block.m_Record.GetData(), block.m_Record.GetSize());
+    stream = CroStream(record);
 
-    return false;
+    stream.SetPosition(block.m_AttrStart);
+    return true;
 }
 
 bool CroStruParser::LoadBankProps()
@@ -265,19 +311,18 @@ bool CroStruParser::LoadBankProps()
         if (prop.IsRef())
         {
             cronos_id blockId = prop.RefBlockId();
-            croblock_type type = GetBlockType(blockId);
-            if (type != CROBLOCK_PROP)
+            crostru_block& ref = GetBlock(blockId);
+            if (ref.m_Type != CROBLOCK_PROP)
             {
                 throw std::runtime_error("ref block is not a prop");
             }
 
-            CroBuffer record = m_pStru->LoadRecord(blockId);
-            if (record.IsEmpty())
+            if (ref.m_Record.IsEmpty())
             {
                 throw std::runtime_error("prop ref block is empty");
             }
 
-            CroStream block = CroStream(record);
+            CroStream block = CroStream(ref.m_Record);
             block.Read<uint8_t>();
 
             cronos_size propSize = block.Remaining();
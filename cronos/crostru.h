@@ -6,6 +6,7 @@
 #include "crorecord.h"
 #include <string>
 #include <map>
+#include <unordered_map>
 
 #define CROATTR_PREFIX         0x03
 
@@ -100,6 +101,7 @@ public:
     inline unsigned FieldCount() { return m_Fields.size(); }
     CroField* GetFieldByIndex(unsigned idx);
     CroField* GetFieldByDataIndex(unsigned idx);
+    inline void AddField(const CroField& field) { m_Fields.push_back(field); }
 
     uint16_t m_VocFlags;
     uint16_t m_BaseVersion;
@@ -137,6 +139,16 @@ enum croblock_type : uint8_t {
     CROBLOCK_PROP = CROPROP_PREFIX
 };
 
+struct crostru_block {
+    croblock_type m_Type;
+    bool m_bDecoded;
+    CroBuffer m_Record;
+    cronos_off m_AttrStart;
+};
+
+// All STRU blocks are read once, in id order, on the first lookup. Only
+// attribute blocks are decoded then, to index their names; prop blocks
+// keep the raw record until a reference resolves them.
 class CroStruParser : public CroParser
 {
 public:
@@ -150,7 +162,14 @@ public:
     
     bool LoadBankProps();
 private:
+    void IndexBlocks();
+    crostru_block& GetBlock(cronos_id blockId);
+
     CroRecordMap* m_pStru;
+
+    bool m_bIndexed;
+    std::unordered_map<cronos_id, crostru_block> m_Blocks;
+    std::unordered_map<std::string, cronos_id> m_Attrs;
 };
 
 #endif
@@ -1,7 +1,63 @@
 #include "crosync.h"
 #include <stdexcept>
+#include <algorithm>
+#include <string.h>
 #include <win32util.h>
 
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#ifdef WIN32
+#include <windows.h>
+#include <io.h>
+#endif
+
+cronos_size CroReadAt(FILE* fp, void* buf, cronos_size size, cronos_off off)
+{
+#ifdef WIN32
+    HANDLE file = (HANDLE)_get_osfhandle(_fileno(fp));
+    cronos_size done = 0;
+    while (done < size)
+    {
+        // an explicit offset per call, the handle pointer it moves is
+        // never used by other readers
+        OVERLAPPED ov = {};
+        ov.Offset = (DWORD)(off + done);
+        ov.OffsetHigh = (DWORD)((off + done) >> 32);
+
+        DWORD part = (DWORD)std::min<cronos_size>(size - done, 0x40000000);
+        DWORD read = 0;
+        if (!ReadFile(file, (uint8_t*)buf + done, part, &read, &ov))
+        {
+            if (GetLastError() == ERROR_HANDLE_EOF) break;
+            return (cronos_size)-1;
+        }
+        if (!read) break;
+        done += read;
+    }
+    return done;
+#else
+    cronos_size done = 0;
+    while (done < size)
+    {
+        ssize_t got = pread(fileno(fp), (uint8_t*)buf + done,
+            size - done, off + done);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return (cronos_size)-1;
+        if (!got) break;
+        done += got;
+    }
+    return done;
+#endif
+}
+
 /* CroSync */
 
 CroSync::CroSync()
@@ -44,9 +100,14 @@ void CroSync::Sync(const void* src, cronos_size size)
 
 void CroSync::Write(const uint8_t* src, cronos_size size)
 {
-    if (size >= Remaining())
+    while (size >= Remaining())
     {
+        cronos_size chunk = Remaining();
+        CroStream::Write(src, chunk);
         Flush();
+
+        src += chunk;
+        size -= chunk;
     }
 
     CroStream::Write(src, size);
@@ -57,27 +118,620 @@ void CroSync::Flush()
     SetPosition(0);
 }
 
+cronos_off CroSync::Checkpoint()
+{
+    Flush();
+    return 0;
+}
+
+/* CroSyncMemory */
+
+void CroSyncMemory::Write(const uint8_t* src, cronos_size size)
+{
+    m_Memory.insert(m_Memory.end(), src, src + size);
+}
+
+void CroSyncMemory::Flush()
+{
+}
+
+cronos_off CroSyncMemory::Checkpoint()
+{
+    return MemorySize();
+}
+
+void CroSyncMemory::Clear()
+{
+    m_Memory.clear();
+}
+
 /* CroSyncFile */
 
-CroSyncFile::CroSyncFile(const std::wstring& path, cronos_size bufferSize)
-    : CroSync(bufferSize), m_FilePath(path)
+CroSyncFile::CroSyncFile(const std::wstring& path, cronos_size bufferSize,
+    cronos_flags flags)
+    : m_FilePath(path), m_Flags(flags), m_Offset(0), m_Allocated(0)
 {
+#ifdef WIN32
+    m_fFile = NULL;
+    m_Flags &= ~(CROSYNC_DIRECT | CROSYNC_PREALLOC);
+#else
+    m_iFile = -1;
+#endif
+
+    if (IsDirect())
+    {
+        void* data = NULL;
+        cronos_size size = std::max<cronos_size>(2 * CROSYNC_ALIGN,
+            (bufferSize + CROSYNC_ALIGN - 1) & ~(cronos_size)(CROSYNC_ALIGN - 1));
+
+#ifndef WIN32
+        if (posix_memalign(&data, CROSYNC_ALIGN, size))
+            throw std::runtime_error("CroSyncFile aligned alloc failed");
+#endif
+
+        InitBuffer((uint8_t*)data, size, true);
+        SetBuffer(this);
+        SetPosition(0);
+    }
+    else
+    {
+        InitSync(bufferSize);
+    }
 }
 
-void CroSyncFile::Flush()
+CroSyncFile::~CroSyncFile()
 {
-    FILE* fSync = _wfopen(m_FilePath.c_str(), L"ab");
-    if (!fSync)
+    try {
+        Close();
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "CroSyncFile close: %s\n", e.what());
+    }
+}
+
+bool CroSyncFile::IsOpen() const
+{
+#ifdef WIN32
+    return m_fFile != NULL;
+#else
+    return m_iFile >= 0;
+#endif
+}
+
+void CroSyncFile::Open()
+{
+    if (IsOpen()) return;
+
+#ifdef WIN32
+    m_fFile = _wfopen(m_FilePath.c_str(),
+        m_Flags & CROSYNC_TRUNCATE ? L"wb" : L"ab");
+    if (!m_fFile)
+        throw std::runtime_error("failed to sync file");
+
+    _fseeki64(m_fFile, 0, SEEK_END);
+    m_Offset = _ftelli64(m_fFile);
+#else
+    std::string path = WcharToText(m_FilePath);
+    int flags = O_WRONLY | O_CREAT;
+    if (m_Flags & CROSYNC_TRUNCATE) flags |= O_TRUNC;
+
+#ifdef O_DIRECT
+    if (IsDirect())
+        m_iFile = open(path.c_str(), flags | O_DIRECT, 0644);
+#endif
+    if (m_iFile < 0)
     {
+        m_Flags &= ~CROSYNC_DIRECT;
+        m_iFile = open(path.c_str(), flags, 0644);
+    }
+
+    if (m_iFile < 0)
         throw std::runtime_error("failed to sync file");
+
+    struct stat st;
+    m_Offset = fstat(m_iFile, &st) ? 0 : st.st_size;
+
+#ifdef O_DIRECT
+    // appending to an unaligned tail is not possible with O_DIRECT
+    if (IsDirect() && m_Offset % CROSYNC_ALIGN)
+    {
+        fcntl(m_iFile, F_SETFL, fcntl(m_iFile, F_GETFL) & ~O_DIRECT);
+        m_Flags &= ~CROSYNC_DIRECT;
+    }
+#endif
+#endif
+
+    m_Allocated = m_Offset;
+    m_Flags &= ~CROSYNC_TRUNCATE;
+}
+
+void CroSyncFile::Close()
+{
+    if (!IsOpen() && SyncEmpty()) return;
+
+    Flush();
+#ifndef WIN32
+    WriteTail();
+
+    // give back what was reserved past the end
+    if (m_Allocated > m_Offset)
+        ftruncate(m_iFile, m_Offset);
+
+    close(m_iFile);
+    m_iFile = -1;
+#else
+    fclose(m_fFile);
+    m_fFile = NULL;
+#endif
+}
+
+void CroSyncFile::ClearDirect()
+{
+#if !defined(WIN32) && defined(O_DIRECT)
+    if (IsDirect())
+        fcntl(m_iFile, F_SETFL, fcntl(m_iFile, F_GETFL) & ~O_DIRECT);
+#endif
+    m_Flags &= ~CROSYNC_DIRECT;
+}
+
+void CroSyncFile::WriteTail()
+{
+#ifndef WIN32
+    // the unaligned tail kept back by the direct path
+    if (SyncEmpty()) return;
+
+    ClearDirect();
+    WriteFile(GetData(), SyncSize());
+    CroSync::Flush();
+#endif
+}
+
+void CroSyncFile::Preallocate(cronos_off end)
+{
+#ifdef __linux__
+    if (!(m_Flags & CROSYNC_PREALLOC) || end <= m_Allocated)
+        return;
+
+    cronos_off next = (end + CROSYNC_PREALLOC_STEP - 1)
+        / CROSYNC_PREALLOC_STEP * CROSYNC_PREALLOC_STEP;
+    if (fallocate(m_iFile, FALLOC_FL_KEEP_SIZE, m_Allocated,
+        next - m_Allocated))
+    {
+        m_Flags &= ~CROSYNC_PREALLOC;
+        return;
+    }
+
+    m_Allocated = next;
+#endif
+}
+
+void CroSyncFile::WriteFile(const uint8_t* data, cronos_size size,
+    const uint8_t* extra, cronos_size extraSize)
+{
+    Preallocate(m_Offset + size + extraSize);
+
+#ifdef WIN32
+    if ((size && fwrite(data, size, 1, m_fFile) != 1)
+        || (extraSize && fwrite(extra, extraSize, 1, m_fFile) != 1))
+    {
+        throw std::runtime_error("failed to sync file");
+    }
+
+    m_Offset += size + extraSize;
+#else
+    struct iovec iov[2] = {
+        { (void*)data, (size_t)size },
+        { (void*)extra, (size_t)extraSize }
+    };
+
+    struct iovec* cur = iov;
+    int count = 2;
+    while (count && !cur->iov_len)
+    {
+        cur++;
+        count--;
+    }
+
+    while (count)
+    {
+        ssize_t written = pwritev(m_iFile, cur, count, m_Offset);
+        if (written < 0)
+        {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("failed to sync file");
+        }
+
+        m_Offset += written;
+        while (count && (size_t)written >= cur->iov_len)
+        {
+            written -= cur->iov_len;
+            cur++;
+            count--;
+        }
+
+        if (count)
+        {
+            cur->iov_base = (uint8_t*)cur->iov_base + written;
+            cur->iov_len -= written;
+        }
+    }
+#endif
+}
+
+void CroSyncFile::Write(const uint8_t* src, cronos_size size)
+{
+    if (IsDirect() || size < Remaining())
+    {
+        CroSync::Write(src, size);
+        return;
+    }
+
+    Open();
+    WriteFile(GetData(), SyncSize(), src, size);
+    CroSync::Flush();
+}
+
+void CroSyncFile::Flush()
+{
+    Open();
+    if (SyncEmpty()) return;
+
+    cronos_size size = SyncSize();
+    if (IsDirect())
+    {
+        cronos_size aligned = size & ~(cronos_size)(CROSYNC_ALIGN - 1);
+        if (aligned)
+        {
+            WriteFile(GetData(), aligned);
+            memmove(GetData(), GetData() + aligned, size - aligned);
+            SetPosition(size - aligned);
+        }
+
+        return;
+    }
+
+    WriteFile(GetData(), size);
+    CroSync::Flush();
+}
+
+cronos_off CroSyncFile::Checkpoint()
+{
+    Flush();
+    WriteTail();
+
+#ifdef WIN32
+    if (fflush(m_fFile) || _commit(_fileno(m_fFile)))
+        throw std::runtime_error("failed to checkpoint file");
+#else
+    if (fsync(m_iFile))
+        throw std::runtime_error("failed to checkpoint file");
+#endif
+
+    return m_Offset;
+}
+
+void CroSyncFile::CopyFrom(FILE* src, cronos_off pos, cronos_size size)
+{
+    Flush();
+    WriteTail();
+    ClearDirect();
+
+#ifdef __linux__
+    int fd = fileno(src);
+    bool bCopyRange = true;
+    while (size)
+    {
+        ssize_t copied;
+        if (bCopyRange)
+        {
+            loff_t in = pos, out = m_Offset;
+            copied = copy_file_range(fd, &in, m_iFile, &out, size, 0);
+        }
+        else
+        {
+            // sendfile writes at the file position, not at an offset
+            off_t in = pos;
+            if (lseek(m_iFile, m_Offset, SEEK_SET) < 0) break;
+            copied = sendfile(m_iFile, fd, &in, size);
+        }
+
+        if (copied < 0)
+        {
+            if (errno == EINTR) continue;
+            if (!bCopyRange) break;
+
+            // older kernels or different file systems
+            bCopyRange = false;
+            continue;
+        }
+        if (!copied)
+            throw std::runtime_error("CroSyncFile copy past end of file");
+
+        pos += copied;
+        size -= copied;
+        m_Offset += copied;
+    }
+    if (!size) return;
+#endif
+
+    std::vector<uint8_t> chunk(std::min<cronos_size>(size,
+        CROSYNC_COPY_CHUNK));
+    while (size)
+    {
+        cronos_size part = std::min<cronos_size>(size, chunk.size());
+
+        // src may be shared with other readers, never seek it
+        if (CroReadAt(src, chunk.data(), part, pos) != part)
+            throw std::runtime_error("CroSyncFile copy read failed");
+
+        WriteFile(chunk.data(), part);
+        pos += part;
+        size -= part;
     }
+}
+
+/* CroSyncWriter */
+
+CroSyncWriter::CroSyncWriter()
+    : m_bStop(false)
+{
+    m_Thread = std::thread(&CroSyncWriter::Run, this);
+}
 
-    if (!SyncEmpty())
+CroSyncWriter::~CroSyncWriter()
+{
     {
-        fwrite(GetData(), SyncSize(), 1, fSync);
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_bStop = true;
     }
 
-    fclose(fSync);
+    m_Cond.notify_all();
+    m_Thread.join();
+}
+
+void CroSyncWriter::Submit(CroSyncAsync* sync, uint8_t* data,
+    cronos_size size)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Jobs.push_back({sync, data, size});
+    }
+
+    m_Cond.notify_one();
+}
+
+void CroSyncWriter::Run()
+{
+    for (;;)
+    {
+        crosync_job job;
+        {
+            std::unique_lock<std::mutex> lock(m_Lock);
+            m_Cond.wait(lock, [this] { return m_bStop || !m_Jobs.empty(); });
+            if (m_Jobs.empty()) return;
+
+            job = m_Jobs.front();
+            m_Jobs.pop_front();
+        }
+
+        job.m_pSync->WriteJob(job.m_pData, job.m_Size);
+    }
+}
+
+/* CroSyncAsync */
+
+CroSyncAsync::CroSyncAsync(CroSync* target, CroSyncWriter* writer,
+    cronos_size bufferSize, unsigned bufferCount)
+    : m_pTarget(target), m_pWriter(writer), m_BufferSize(bufferSize),
+    m_Pending(0)
+{
+    bufferCount = std::max(bufferCount, 2u);
+    m_Pool.Alloc(bufferSize * bufferCount);
 
+    for (unsigned i = 1; i < bufferCount; i++)
+        m_Free.push_back(m_Pool.GetData() + i * bufferSize);
+
+    InitBuffer(m_Pool.GetData(), bufferSize, false);
+    SetBuffer(this);
+    SetPosition(0);
+}
+
+CroSyncAsync::~CroSyncAsync()
+{
+    try {
+        Drain();
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "CroSyncAsync drain: %s\n", e.what());
+    }
+
+    // the writer may still hold buffers of the pool if Drain failed
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Cond.wait(lock, [this] { return !m_Pending; });
+}
+
+void CroSyncAsync::WriteJob(uint8_t* data, cronos_size size)
+{
+    std::exception_ptr error;
+    try {
+        m_pTarget->Write(data, size);
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+
+    // notify under the lock, the producer may destroy the sink as soon
+    // as it sees nothing pending
+    std::lock_guard<std::mutex> lock(m_Lock);
+    if (error && !m_Error) m_Error = error;
+
+    m_Free.push_back(data);
+    m_Pending--;
+    m_Cond.notify_all();
+}
+
+void CroSyncAsync::CheckError()
+{
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        std::swap(error, m_Error);
+    }
+
+    if (error) std::rethrow_exception(error);
+}
+
+void CroSyncAsync::Flush()
+{
+    CheckError();
+    if (SyncEmpty()) return;
+
+    uint8_t* data = GetData();
+    cronos_size size = SyncSize();
+    if (!m_pWriter)
+    {
+        m_pTarget->Write(data, size);
+        CroSync::Flush();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Lock);
+        m_Pending++;
+    }
+    m_pWriter->Submit(this, data, size);
+
+    std::unique_lock<std::mutex> lock(m_Lock);
+    m_Cond.wait(lock, [this] { return !m_Free.empty(); });
+
+    InitBuffer(m_Free.back(), m_BufferSize, false);
+    m_Free.pop_back();
+    SetPosition(0);
+}
+
+void CroSyncAsync::Drain()
+{
+    Flush();
+    {
+        std::unique_lock<std::mutex> lock(m_Lock);
+        m_Cond.wait(lock, [this] { return !m_Pending; });
+    }
+
+    CheckError();
+    m_pTarget->Flush();
+}
+
+cronos_off CroSyncAsync::Checkpoint()
+{
+    Drain();
+    return m_pTarget->Checkpoint();
+}
+
+/* CroSyncCompress */
+
+CroSyncCompress::CroSyncCompress(CroSync* target, CroCodecPool* pool,
+    crocodec_type codec, cronos_size blockSize, int level)
+    : CroSync(blockSize), m_pTarget(target), m_pPool(pool), m_Codec(codec),
+    m_Level(level), m_bWritten(false)
+{
+    if (m_Codec != CroCodec_Gzip && m_Codec != CroCodec_Zstd)
+        throw std::runtime_error("CroSyncCompress needs gzip or zstd");
+    if (!CroCodecAvailable(m_Codec))
+        throw std::runtime_error("compression codec is not available");
+}
+
+CroSyncCompress::~CroSyncCompress()
+{
+    try {
+        Finish();
+    }
+    catch (const std::exception& e) {
+        fprintf(stderr, "CroSyncCompress finish: %s\n", e.what());
+    }
+
+    // blocks still referenced by the pool must outlive their jobs
+    for (auto& block : m_Blocks)
+        if (block->m_Done.valid()) block->m_Done.wait();
+}
+
+void CroSyncCompress::QueueBlock(const uint8_t* data, cronos_size size)
+{
+    std::unique_ptr<crosync_block> block;
+    if (!m_Spare.empty())
+    {
+        block = std::move(m_Spare.back());
+        m_Spare.pop_back();
+    }
+    else block = std::make_unique<crosync_block>();
+
+    block->m_Data.assign(data, data + size);
+    block->m_Packed.clear();
+    if (m_pPool)
+    {
+        block->m_Done = m_pPool->Compress(m_Codec, block->m_Data.data(),
+            block->m_Data.size(), block->m_Packed, m_Level);
+    }
+    else
+    {
+        CroCompress(m_Codec, block->m_Data.data(), block->m_Data.size(),
+            block->m_Packed, m_Level);
+    }
+
+    m_Blocks.push_back(std::move(block));
+    m_bWritten = true;
+}
+
+void CroSyncCompress::WriteBlock()
+{
+    std::unique_ptr<crosync_block> block = std::move(m_Blocks.front());
+    m_Blocks.pop_front();
+
+    if (block->m_Done.valid()) block->m_Done.get();
+    m_pTarget->Write(block->m_Packed.data(), block->m_Packed.size());
+
+    m_Spare.push_back(std::move(block));
+}
+
+void CroSyncCompress::Flush()
+{
+    if (SyncEmpty()) return;
+
+    QueueBlock(GetData(), SyncSize());
     CroSync::Flush();
+
+    size_t inflight = m_pPool ? 2 * m_pPool->ThreadCount() : 0;
+    while (m_Blocks.size() > inflight)
+        WriteBlock();
+
+    // write whatever is already done without waiting
+    while (!m_Blocks.empty())
+    {
+        std::future<void>& done = m_Blocks.front()->m_Done;
+        if (done.valid() && done.wait_for(std::chrono::seconds(0))
+            != std::future_status::ready) break;
+
+        WriteBlock();
+    }
+}
+
+cronos_off CroSyncCompress::Checkpoint()
+{
+    // every block is a complete member, so the file can be cut after it
+    Flush();
+    while (!m_Blocks.empty())
+        WriteBlock();
+
+    return m_pTarget->Checkpoint();
+}
+
+void CroSyncCompress::Finish()
+{
+    Flush();
+
+    // an empty stream still has to be a valid gzip/zstd file
+    if (!m_bWritten) QueueBlock(NULL, 0);
+
+    while (!m_Blocks.empty())
+        WriteBlock();
+    m_pTarget->Flush();
 }
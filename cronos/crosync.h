@@ -3,7 +3,26 @@
 
 #include "crobuffer.h"
 #include "crostream.h"
+#include "crocodec.h"
 #include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdio.h>
+
+#define CROSYNC_DIRECT          (1 << 0)
+#define CROSYNC_PREALLOC        (1 << 1)
+#define CROSYNC_TRUNCATE        (1 << 2)
+
+#define CROSYNC_ALIGN           4096
+#define CROSYNC_PREALLOC_STEP   (32*1024*1024)
+#define CROSYNC_ASYNC_BUFFERS   4
+#define CROSYNC_COMPRESS_BLOCK  (1024*1024)
+#define CROSYNC_COPY_CHUNK      (1024*1024)
 
 class CroSync : protected CroBuffer, protected CroStream
 {
@@ -24,16 +43,176 @@ public:
 
     virtual void Write(const uint8_t* src, cronos_size size);
     virtual void Flush();
+
+    // Writes out everything buffered so far down to stable storage and
+    // returns the size of the underlying file at that point.
+    virtual cronos_off Checkpoint();
+};
+
+// Collects everything written into a growing memory block, used where
+// output has to be produced first and placed later.
+class CroSyncMemory : public CroSync
+{
+public:
+    inline const uint8_t* MemoryData() const { return m_Memory.data(); }
+    inline cronos_size MemorySize() const { return m_Memory.size(); }
+
+    void Write(const uint8_t* src, cronos_size size) override;
+    void Flush() override;
+    cronos_off Checkpoint() override;
+    void Clear();
+private:
+    std::vector<uint8_t> m_Memory;
 };
 
+// Reads up to size bytes at off without using or moving the FILE
+// position, so readers may share one FILE. Returns the bytes read, short
+// only at end of file, or (cronos_size)-1 on error.
+cronos_size CroReadAt(FILE* fp, void* buf, cronos_size size, cronos_off off);
+
+// Keeps the file open between flushes. Buffers that do not fit are
+// written together with the pending data in one gathered write.
+// CROSYNC_PREALLOC reserves disk space ahead in CROSYNC_PREALLOC_STEP
+// steps, CROSYNC_DIRECT bypasses the page cache with an aligned buffer,
+// carrying the unaligned tail over to the next flush. Both fall back
+// silently where the platform or file system has no support.
+// CROSYNC_TRUNCATE empties an existing file instead of appending to it.
+// CopyFrom appends a range of another file without passing it through
+// user space where the kernel allows.
 class CroSyncFile : public CroSync
 {
 public:
-    CroSyncFile(const std::wstring& path, cronos_size bufferSize);
+    CroSyncFile(const std::wstring& path, cronos_size bufferSize,
+        cronos_flags flags = 0);
+    virtual ~CroSyncFile();
+
+    inline const std::wstring& GetPath() const { return m_FilePath; }
+    inline cronos_off GetFileOffset() const { return m_Offset; }
+    inline bool IsDirect() const { return m_Flags & CROSYNC_DIRECT; }
+    bool IsOpen() const;
 
+    void Write(const uint8_t* src, cronos_size size) override;
     void Flush() override;
+    cronos_off Checkpoint() override;
+    void CopyFrom(FILE* src, cronos_off pos, cronos_size size);
+    void Close();
 private:
+    void Open();
+    void ClearDirect();
+    void WriteTail();
+    void WriteFile(const uint8_t* data, cronos_size size,
+        const uint8_t* extra = NULL, cronos_size extraSize = 0);
+    void Preallocate(cronos_off end);
+
     std::wstring m_FilePath;
+    cronos_flags m_Flags;
+#ifdef WIN32
+    FILE* m_fFile;
+#else
+    int m_iFile;
+#endif
+    cronos_off m_Offset;
+    cronos_off m_Allocated;
+};
+
+class CroSyncAsync;
+
+struct crosync_job {
+    CroSyncAsync* m_pSync;
+    uint8_t* m_pData;
+    cronos_size m_Size;
+};
+
+// Background thread writing the buffers handed over by CroSyncAsync.
+// Jobs are written in submission order, so every sink sees its data in
+// order. One writer is meant to be shared by all sinks of a task.
+class CroSyncWriter
+{
+public:
+    CroSyncWriter();
+    ~CroSyncWriter();
+
+    void Submit(CroSyncAsync* sync, uint8_t* data, cronos_size size);
+private:
+    void Run();
+
+    std::mutex m_Lock;
+    std::condition_variable m_Cond;
+    std::deque<crosync_job> m_Jobs;
+    bool m_bStop;
+    std::thread m_Thread;
+};
+
+// Owns the target sink and a pool of N buffers. Flush hands the filled
+// buffer to the writer and continues in the next free one, blocking only
+// when all N are still queued. Errors raised by the target on the writer
+// thread are rethrown on the next Flush or Drain. Without a writer the
+// buffers are written in place.
+class CroSyncAsync : public CroSync
+{
+public:
+    CroSyncAsync(CroSync* target, CroSyncWriter* writer,
+        cronos_size bufferSize, unsigned bufferCount = CROSYNC_ASYNC_BUFFERS);
+    virtual ~CroSyncAsync();
+
+    inline CroSync* GetTarget() const { return m_pTarget.get(); }
+
+    void Flush() override;
+    cronos_off Checkpoint() override;
+    void Drain();
+private:
+    friend class CroSyncWriter;
+    void WriteJob(uint8_t* data, cronos_size size);
+    void CheckError();
+
+    std::unique_ptr<CroSync> m_pTarget;
+    CroSyncWriter* m_pWriter;
+
+    CroBuffer m_Pool;
+    cronos_size m_BufferSize;
+    std::vector<uint8_t*> m_Free;
+    unsigned m_Pending;
+
+    std::mutex m_Lock;
+    std::condition_variable m_Cond;
+    std::exception_ptr m_Error;
+};
+
+struct crosync_block {
+    std::vector<uint8_t> m_Data;
+    std::vector<uint8_t> m_Packed;
+    std::future<void> m_Done;
+};
+
+// Compresses every filled buffer as an independent gzip member or zstd
+// frame on the codec pool and writes the results to the target in order,
+// which yields a standard multi-member gzip or multi-frame zstd stream.
+// At most two blocks per pool thread are in flight.
+class CroSyncCompress : public CroSync
+{
+public:
+    CroSyncCompress(CroSync* target, CroCodecPool* pool, crocodec_type codec,
+        cronos_size blockSize = CROSYNC_COMPRESS_BLOCK,
+        int level = CROCODEC_DEFAULT_LEVEL);
+    virtual ~CroSyncCompress();
+
+    inline CroSync* GetTarget() const { return m_pTarget.get(); }
+
+    void Flush() override;
+    cronos_off Checkpoint() override;
+    void Finish();
+private:
+    void QueueBlock(const uint8_t* data, cronos_size size);
+    void WriteBlock();
+
+    std::unique_ptr<CroSync> m_pTarget;
+    CroCodecPool* m_pPool;
+    crocodec_type m_Codec;
+    int m_Level;
+
+    std::deque<std::unique_ptr<crosync_block>> m_Blocks;
+    std::vector<std::unique_ptr<crosync_block>> m_Spare;
+    bool m_bWritten;
 };
 
 class ICroFileExport
@@ -76,4 +76,6 @@ enum class CroType : uint16_t {
 typedef uint32_t CroIdent;
 typedef int64_t CroInteger;
 
+#define INVALID_CRONOS_IDENT (CroIdent)-1
+
 #endif